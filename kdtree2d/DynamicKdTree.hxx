@@ -0,0 +1,311 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: DynamicKdTree.hxx 2026/10/18 19:12:05 kanai Exp $
+//
+// Copyright (c) 2026 Takashi Kanai
+// Released under the MIT license
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef __DYNAMICKDTREE_HXX__
+#define __DYNAMICKDTREE_HXX__
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <utility>
+using namespace std;
+
+#include "myEigen.hxx"
+#include "ThreadPool.hxx"
+#include "KdTree.hxx"
+
+//
+// 点の追加・削除ができる N次元 kD-Tree (静的な KdTree<N, Scalar> の対数個の森)
+// - i 番目の木は BASE_SIZE << i 個以下の点を持つ (空の木もある)
+// - 追加: 新しい点と，先頭から順に空でない木の点をまとめ，それが入る最初の空の木として作り直す
+//   (2進数の繰り上がりと同じ．1 点あたり O(log^2 n) の償却時間)
+// - 削除: 点に削除の印を付けるだけで，探索では除く．木の半分を超える点が削除されたら
+//   その木を残りの点で作り直す
+// - 点には追加した順に通し番号 (id) を付ける．id は削除しても変わらず，再利用しない
+//   (削除した点の座標も points_ に残る)
+// - 探索の関数は KdTree<N, Scalar> と同じで，返すインデックスは id．K近傍点の探索は
+//   1 つのヒープを全ての木で共有するので，先に調べた木の結果で後の木の枝刈りができる
+//
+template<int N, class Scalar = double>
+class DynamicKdTree {
+
+public:
+
+  typedef Eigen::Matrix<Scalar,N,1> Point;
+
+  // 0 番目の木の点の数の上限
+  enum { BASE_SIZE = 32 };
+
+  DynamicKdTree(int bucket_size = 16) : n_alive_(0), bucket_size_(bucket_size) {};
+  ~DynamicKdTree(){ clear(); };
+
+  DynamicKdTree(const DynamicKdTree&) = delete;
+  DynamicKdTree& operator=(const DynamicKdTree&) = delete;
+
+  void clear() {
+    for (auto s : slots_) delete s;
+    slots_.clear();
+    points_.clear();
+    slot_of_.clear();
+    n_alive_ = 0;
+  };
+
+  // 削除されていない点の数
+  int size() const { return n_alive_; };
+  // これまでに付けた id の数 (id は 0 ... idSize()-1)
+  int idSize() const { return (int) points_.size(); };
+
+  bool isAlive(int id) const { return (id >= 0) && (id < idSize()) && (slot_of_[id] >= 0); };
+  const Point& point(int id) const { return points_[id]; };
+
+  // 木の数 (空の木を含む) と i 番目の木 (空なら nullptr)．木の点のインデックス j の id は treeID(i, j)
+  int treesSize() const { return (int) slots_.size(); };
+  const KdTree<N, Scalar>* tree(int i) const { return (slots_[i] != nullptr) ? &(slots_[i]->tree) : nullptr; };
+  int treeID(int i, int j) const { return slots_[i]->ids[j]; };
+
+  // 点の追加: 点の id を返す
+  int insert(const Point& p, ThreadPool& pool = ThreadPool::instance()) {
+    int id = addPoint(p);
+    std::vector<int> ids(1, id);
+    place(ids, pool);
+    return id;
+  };
+
+  // 点の一括追加: 最初の点の id を返す (points[i] の id は 戻り値 + i)
+  int insert(const std::vector<Point>& points,
+             ThreadPool& pool = ThreadPool::instance()) {
+    int first = idSize();
+    if (points.empty()) return first;
+    std::vector<int> ids(points.size());
+    for (int i = 0; i < (int) points.size(); ++i) ids[i] = addPoint(points[i]);
+    place(ids, pool);
+    return first;
+  };
+
+  // 点の削除: 削除した場合 true (すでに削除されている場合は false)
+  bool erase(int id, ThreadPool& pool = ThreadPool::instance()) {
+    if (!isAlive(id)) return false;
+    int i = slot_of_[id];
+    Slot* s = slots_[i];
+    slot_of_[id] = -1;
+    --n_alive_;
+    if (2 * (++(s->n_dead)) > (int) s->ids.size()) {
+      std::vector<int> ids;
+      gather(i, ids);
+      if (!ids.empty()) build(i, ids, pool);
+    }
+    return true;
+  };
+
+  // 最近傍点の探索: 最近傍点の id を返す (点がなければ -1)
+  int nnSearch(const Point& q, double* min_dis = nullptr) const {
+    std::pair<double,int> buf(std::numeric_limits<double>::max(), -1);
+    typename KdTree<N, Scalar>::KnnHeap heap(&buf, 1);
+    knnVisit(q, heap);
+    if (min_dis != nullptr) *min_dis = (heap.size > 0) ? std::sqrt(buf.first) : buf.first;
+    return (heap.size > 0) ? buf.second : -1;
+  };
+
+  // K近傍点の探索: k個の近傍点の id を距離の近い順に返す
+  std::vector<int> knnSearch(const Point& q, int k) const {
+    std::vector<int> indices;
+    if ((k <= 0) || (n_alive_ == 0)) return indices;
+
+    std::vector<std::pair<double,int> > buf(std::min(k, n_alive_));
+    typename KdTree<N, Scalar>::KnnHeap heap(buf.data(), (int) buf.size());
+    knnVisit(q, heap);
+    heap.sort();
+
+    indices.resize(heap.size);
+    for (int i = 0; i < heap.size; ++i) indices[i] = heap.data[i].second;
+    return indices;
+  };
+
+  // 半径探索: 半径r内の点の id を返す
+  std::vector<int> radiusSearch(const Point& q, double r) const {
+    std::vector<int> indices;
+    if (r < .0) return indices;
+    radiusVisit(q, r * r, [&indices](int id, double) { indices.push_back(id); return true; });
+    return indices;
+  };
+
+  // 半径探索 (ビジター): KdTree<N, Scalar>::radiusSearch(q, r, visitor) と同じ (点のインデックスは id)
+  template <class Visitor>
+  bool radiusSearch(const Point& q, double r, Visitor&& visitor) const {
+    if (r < .0) return true;
+    return radiusVisit(q, r * r, visitor);
+  };
+
+  // K近傍点の一括探索 (出力は KdTree<N, Scalar>::knnSearchBatch と同じ CSR 形式)
+  void knnSearchBatch(const std::vector<Point>& queries, int k,
+                      std::vector<int>& offsets, std::vector<int>& indices,
+                      std::vector<double>* dists = nullptr,
+                      ThreadPool& pool = ThreadPool::instance()) const {
+    int n_q = (int) queries.size(), kk = std::max(0, std::min(k, n_alive_));
+    offsets.resize(n_q + 1);
+    for (int i = 0; i <= n_q; ++i) offsets[i] = i * kk;
+    indices.resize((size_t) n_q * kk);
+    if (dists != nullptr) dists->resize((size_t) n_q * kk);
+    if ((kk == 0) || (n_q == 0)) return;
+
+    int n_chunks = std::min(n_q, 8 * pool.size());
+    std::vector<std::pair<double,int> > buf((size_t) n_chunks * kk);
+    parallelFor(pool, 0, n_chunks, 1, [&](int c) {
+        typename KdTree<N, Scalar>::KnnHeap heap(&buf[(size_t) c * kk], kk);
+        for (int i = KdTree<N, Scalar>::chunkBegin(n_q, n_chunks, c); i < KdTree<N, Scalar>::chunkBegin(n_q, n_chunks, c + 1); ++i) {
+          heap.size = 0;
+          knnVisit(queries[i], heap);
+          heap.sort();
+          for (int j = 0; j < kk; ++j) {
+            indices[(size_t) i * kk + j] = heap.data[j].second;
+            if (dists != nullptr) (*dists)[(size_t) i * kk + j] = std::sqrt(heap.data[j].first);
+          }
+        } });
+  };
+
+  // 半径探索の一括処理 (出力は KdTree<N, Scalar>::radiusSearchBatch と同じ CSR 形式)
+  void radiusSearchBatch(const std::vector<Point>& queries, double r,
+                         std::vector<int>& offsets, std::vector<int>& indices,
+                         std::vector<double>* dists = nullptr,
+                         ThreadPool& pool = ThreadPool::instance()) const {
+    int n_q = (int) queries.size();
+    offsets.assign(n_q + 1, 0);
+    if (r < .0) {
+      indices.clear();
+      if (dists != nullptr) dists->clear();
+      return;
+    }
+    double r2 = r * r;
+
+    parallelFor(pool, 0, n_q, 64, [&](int i) {
+        int cnt = 0;
+        radiusVisit(queries[i], r2, [&cnt](int, double) { ++cnt; return true; });
+        offsets[i + 1] = cnt; });
+    for (int i = 0; i < n_q; ++i) offsets[i + 1] += offsets[i];
+
+    indices.resize(offsets[n_q]);
+    if (dists != nullptr) dists->resize(offsets[n_q]);
+    parallelFor(pool, 0, n_q, 64, [&](int i) {
+        int j = offsets[i];
+        radiusVisit(queries[i], r2, [&](int id, double d2) {
+            indices[j] = id;
+            if (dists != nullptr) (*dists)[j] = std::sqrt(d2);
+            ++j;
+            return true; }); });
+  };
+
+private:
+
+  // 森の 1 本の木: ids[j] が木の j 番目の点の id
+  struct Slot {
+    KdTree<N, Scalar> tree;
+    std::vector<int> ids;
+    int n_dead; // 削除の印が付いた点の数
+    Point bb_min, bb_max; // 点のバウンディングボックス
+
+    // q からボックスまでの距離の2乗
+    double boxDistance2(const Point& q) const {
+      double d2 = .0;
+      for (int j = 0; j < N; ++j) {
+        double d = std::max(.0, (double) std::max(bb_min[j] - q[j], q[j] - bb_max[j]));
+        d2 += d * d;
+      }
+      return d2;
+    };
+
+    Slot(int bucket_size) : tree(bucket_size), n_dead(0) {};
+  };
+
+  int addPoint(const Point& p) {
+    points_.push_back(p);
+    slot_of_.push_back(-1);
+    ++n_alive_;
+    return (int) points_.size() - 1;
+  };
+
+  // i 番目の木の上限
+  static long long capacity(int i) { return (long long) BASE_SIZE << i; };
+
+  // 点 ids を森に入れる (ids の中身は木に移す)
+  void place(std::vector<int>& ids, ThreadPool& pool) {
+    for (int i = 0; ; ++i) {
+      if (i == (int) slots_.size()) slots_.push_back(nullptr);
+      if ((slots_[i] == nullptr) && ((long long) ids.size() <= capacity(i))) {
+        build(i, ids, pool);
+        return;
+      }
+      gather(i, ids);
+    }
+  };
+
+  // i 番目の木の削除されていない点を ids に加え，木を空にする
+  void gather(int i, std::vector<int>& ids) {
+    Slot* s = slots_[i];
+    if (s == nullptr) return;
+    for (auto id : s->ids)
+      if (slot_of_[id] >= 0) ids.push_back(id);
+    delete s;
+    slots_[i] = nullptr;
+  };
+
+  // 点 ids で i 番目の木を作る
+  void build(int i, std::vector<int>& ids, ThreadPool& pool) {
+    Slot* s = new Slot(bucket_size_);
+    std::vector<Point> pts(ids.size());
+    for (int j = 0; j < (int) ids.size(); ++j) {
+      pts[j] = points_[ids[j]];
+      slot_of_[ids[j]] = i;
+    }
+    s->bb_min = s->bb_max = pts[0];
+    for (auto& p : pts) {
+      s->bb_min = s->bb_min.cwiseMin(p);
+      s->bb_max = s->bb_max.cwiseMax(p);
+    }
+    s->ids.swap(ids);
+    s->tree.construct(std::move(pts), pool);
+    slots_[i] = s;
+  };
+
+  // 全ての木でヒープを共有して K近傍点を探す (大きい木から．ボックスが遠い木は飛ばす)
+  void knnVisit(const Point& q, typename KdTree<N, Scalar>::KnnHeap& heap) const {
+    for (int i = (int) slots_.size() - 1; i >= 0; --i) {
+      const Slot* s = slots_[i];
+      if (s == nullptr) continue;
+      if (heap.full() && (s->boxDistance2(q) >= heap.top())) continue;
+      s->tree.knnSearchNode(q, 0, heap, [this, s](int j) {
+          int id = s->ids[j];
+          return (slot_of_[id] >= 0) ? id : -1; });
+    }
+  };
+
+  // 半径内の削除されていない点ごとに f(id, 距離の2乗) を呼ぶ (f が false を返したら打ち切る)
+  template <class Func>
+  bool radiusVisit(const Point& q, double r2, Func&& f) const {
+    for (auto s : slots_) {
+      if ((s == nullptr) || (s->boxDistance2(q) > r2)) continue;
+      auto g = [this, s, &f](int j, double d2) {
+        int id = s->ids[j];
+        return (slot_of_[id] < 0) || f(id, d2); };
+      if (!s->tree.radiusSearchNode(q, r2, 0, g)) return false;
+    }
+    return true;
+  };
+
+  //
+  // メンバ変数
+  //
+  std::vector<Slot*> slots_;                       // 森 (空の木は nullptr)
+  std::vector<Point> points_;   // id の順の点
+  std::vector<int> slot_of_;                       // 点が入っている木の番号 (削除済みは -1)
+  int n_alive_;
+  int bucket_size_;
+};
+
+#endif // __DYNAMICKDTREE_HXX__
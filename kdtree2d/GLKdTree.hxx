@@ -43,10 +43,9 @@ public:
     ::glPointSize( 2.0f );
     ::glColor3f( .0f, .0f, .0f );
 
-    std::vector<Eigen::Vector<double,N> >& points = kdtree().points();
     ::glBegin( GL_POINTS );
-    for ( int i = 0; i < points.size() ; ++i ) {
-      Eigen::Vector<double,N>& p = points[i];
+    for ( int i = 0; i < kdtree().size() ; ++i ) {
+      const Eigen::Vector<double,N>& p = kdtree().point(i);
       ::glVertex2f( p[0], p[1] );
     }
     ::glEnd();
@@ -61,7 +60,7 @@ public:
 
     ::glBegin( GL_POINTS );
     for ( int i = 0; i < idx.size() ; ++i ) {
-      Eigen::Vector<double,N>& p = kdtree().points()[idx[i]];
+      const Eigen::Vector<double,N>& p = kdtree().point(idx[i]);
       ::glVertex2f( p[0], p[1] );
     }
     ::glEnd();
@@ -74,76 +73,50 @@ public:
     ::glLineWidth( 1.0f );
     ::glColor3f( .0f, .0f, 1.0f );
 
-    std::vector<Eigen::Vector<double,N> >& points = kdtree().points();
-
     float bbMin[2], bbMax[2];
     bbMin[0] = .0f;
     bbMin[1] = .0f;
     bbMax[0] = width_;
     bbMax[1] = height_;
 
-    drawTreeRange2d( points, kdtree().root(), 0, points.size()-1, 0, bbMin, bbMax );
+    if ( kdtree().nodes().empty() ) return;
+    drawTreeRange2d( 0, bbMin, bbMax );
   };
 
-  void drawTreeRange2d( std::vector<Eigen::Vector<double,N> >& points, // myPoint* p,
-                        KdNode* node,
-                        int left,
-                        int right,
-                        int splitDimension,
+  //
+  // ノード id の部分木の分割線を描く (葉は何も描かない)
+  //
+  void drawTreeRange2d( int id,
                         float bbMin[],
                         float bbMax[] ) {
 
-    if ( node == nullptr ) return;
-
-    // Calculate the index of this node:
-    int mid=(left+right)>>1;
+    const KdNode& node = kdtree().nodes()[id];
+    if ( node.isLeaf() ) return;
 
-    // Calculate this node's bounding box:
-    Eigen::Vector<double,N>& p = points[node->idx()];
+    int axis = node.axis();
+    float s = (float) node.split();
 
     ::glBegin( GL_LINES );
-    if ( splitDimension == 1 ) { // x
-      ::glVertex2f( bbMin[0], p[1] );
-      ::glVertex2f( bbMax[0], p[1] );
-    } else {
-      ::glVertex2f( p[0], bbMin[1] );
-      ::glVertex2f( p[0], bbMax[1] );
+    if ( axis == 1 ) { // y で分割
+      ::glVertex2f( bbMin[0], s );
+      ::glVertex2f( bbMax[0], s );
+    } else {           // x で分割
+      ::glVertex2f( s, bbMin[1] );
+      ::glVertex2f( s, bbMax[1] );
     }
     ::glEnd();
 
-    int childSplitDimension = (splitDimension + 1) % N;
-
+    // 子ノードの範囲: 分割軸の側だけを分割値で切る
     float childMin[2], childMax[2];
-    if ( left < mid ) {
-      if ( childSplitDimension == 0 ) {
-        childMin[0] = bbMin[0];
-        childMax[0] = bbMax[0];
-        childMin[1] = bbMin[1];
-        childMax[1] = p[1];
-      } else {
-        childMin[0] = bbMin[0];
-        childMax[0] = p[0];
-        childMin[1] = bbMin[1];
-        childMax[1] = bbMax[1];
-      }
-      drawTreeRange2d( points, node->child(0), left, mid-1, childSplitDimension, childMin, childMax );
-    }
-
-    if ( right > mid ) {
-      if ( childSplitDimension == 0 ) {
-        childMin[0] = bbMin[0];
-        childMax[0] = bbMax[0];
-        childMin[1] = p[1];
-        childMax[1] = bbMax[1];
-      } else {
-        childMin[0] = p[0];
-        childMax[0] = bbMax[0];
-        childMin[1] = bbMin[1];
-        childMax[1] = bbMax[1];
-      }
-      drawTreeRange2d( points, node->child(1), mid+1, right, childSplitDimension, childMin, childMax );
-    }
-
+    childMin[0] = bbMin[0]; childMin[1] = bbMin[1];
+    childMax[0] = bbMax[0]; childMax[1] = bbMax[1];
+    if ( axis < 2 ) childMax[axis] = s;
+    drawTreeRange2d( id + 1, childMin, childMax );
+
+    childMin[0] = bbMin[0]; childMin[1] = bbMin[1];
+    childMax[0] = bbMax[0]; childMax[1] = bbMax[1];
+    if ( axis < 2 ) childMin[axis] = s;
+    drawTreeRange2d( node.right(), childMin, childMax );
   };
 
 private:
@@ -11,141 +11,789 @@
 #define __KDTREE_HXX__
 
 #include <vector>
-#include <queue>
 #include <cmath>
 #include <limits>
 #include <numeric>
+#include <algorithm>
+#include <utility>
+#include <map>
 using namespace std;
 
 #include "myEigen.hxx"
+#include "ThreadPool.hxx"
+#include "pq.h"
 
 //
-// kD-Tree のノード
-// - axis_ 上の中間点 points[idx_] を持つ
-// - 子ノードのポインタを持つ
+// kD-Tree のノード (ノードの配列 nodes_ に深さ優先の順で並べる)
+// - 内部ノード: axis_ 上の分割値 split_ を持つ．左の子は直後のノード，右の子は right_
+// - 葉: 木の順に並べた点の範囲 [begin_, end_) を持つ (axis_ = -1)
 //
 class KdNode {
 
 public:
 
-  KdNode() : idx_(-1), axis_(-1) { child_[0] = child_[1] = nullptr; };
-  KdNode(int idx, int axis) : idx_(idx), axis_(axis) { child_[0] = child_[1] = nullptr; };
+  KdNode() : split_(.0), begin_(0), end_(0), axis_(-1), right_(-1) {};
   ~KdNode(){};
 
-  int idx() const { return idx_; };
+  bool isLeaf() const { return (axis_ < 0); };
+  double split() const { return split_; };
   int axis() const { return axis_; };
+  int begin() const { return begin_; };
+  int end() const { return end_; };
+  int right() const { return right_; };
 
-  KdNode* child(int i) { return child_[i]; };
-  void setChild(int i, KdNode* node) { child_[i] = node; };
+  void setLeaf(int b, int e) { begin_ = b; end_ = e; axis_ = -1; };
+  void setSplit(int axis, double split, int b, int e) { axis_ = axis; split_ = split; begin_ = b; end_ = e; };
+  void setRight(int right) { right_ = right; };
 
 private:
 
-  int idx_;          // 点のインデックス
-  KdNode* child_[2]; // 子ノードのポインタ
-  int axis_;         // N次元の軸 (0 ... N-1)
+  double split_; // 分割値
+  int begin_;    // 部分木の点の範囲 [begin_, end_)
+  int end_;
+  int axis_;     // N次元の軸 (0 ... N-1)．葉は -1
+  int right_;    // 右の子のノード番号
+};
+
+//
+// 近似探索の設定
+// - eps: 返す k 番目の点の距離は真の k 番目の距離の (1 + eps) 倍以内 (0 で厳密)
+// - max_leaves: 調べる葉の数の上限 (0 で無制限)．k 個見つかるまでは上限を超えて調べる
+//   上限で打ち切った場合は eps の保証はない
+//
+class KdSearchParams {
+
+public:
+
+  explicit KdSearchParams(double eps = .0, int max_leaves = 0) : eps(eps), max_leaves(max_leaves) {};
+
+  double eps;
+  int max_leaves;
+};
+
+//
+// 探索の統計 (1 クエリ分)
+//
+class KdSearchStats {
+
+public:
+
+  KdSearchStats() { clear(); };
+
+  void clear() { nodes = leaves = points = 0; };
+
+  int nodes;  // 辿ったノードの数 (葉を含む)
+  int leaves; // 調べた葉の数
+  int points; // 距離を計算した点の数
+};
+
+//
+// 葉の点とクエリ点 q との距離の2乗 d2[0 ... cnt-1]
+// - 軸 d の i 番目の点の座標は c[d * stride + i] (SoA)
+// - 一般の N は軸ごとのループで d2[] に足し込む．2次元・3次元は軸を展開して 1 回のループで求める
+//   (いずれもコンパイラが SSE/AVX 命令にベクトル化する)
+//
+template <int N, class Scalar>
+struct KdLeafDistance {
+  static void compute(const Scalar* c, size_t stride, int cnt, const Scalar* q, Scalar* d2) {
+    for (int i = 0; i < cnt; ++i) d2[i] = 0;
+    for (int d = 0; d < N; ++d) {
+      const Scalar* cd = c + d * stride;
+      Scalar qd = q[d];
+      for (int i = 0; i < cnt; ++i) {
+        Scalar t = cd[i] - qd;
+        d2[i] += t * t;
+      }
+    }
+  };
+};
+
+template <class Scalar>
+struct KdLeafDistance<2, Scalar> {
+  static void compute(const Scalar* c, size_t stride, int cnt, const Scalar* q, Scalar* d2) {
+    const Scalar* x = c;
+    const Scalar* y = c + stride;
+    Scalar qx = q[0], qy = q[1];
+    for (int i = 0; i < cnt; ++i) {
+      Scalar dx = x[i] - qx, dy = y[i] - qy;
+      d2[i] = dx * dx + dy * dy;
+    }
+  };
+};
+
+template <class Scalar>
+struct KdLeafDistance<3, Scalar> {
+  static void compute(const Scalar* c, size_t stride, int cnt, const Scalar* q, Scalar* d2) {
+    const Scalar* x = c;
+    const Scalar* y = c + stride;
+    const Scalar* z = c + 2 * stride;
+    Scalar qx = q[0], qy = q[1], qz = q[2];
+    for (int i = 0; i < cnt; ++i) {
+      Scalar dx = x[i] - qx, dy = y[i] - qy, dz = z[i] - qz;
+      d2[i] = dx * dx + dy * dy + dz * dz;
+    }
+  };
 };
 
 //
 // N次元 kD-Tree クラス
-// - N はテンプレートで指定
-// - root_ を根とする KdNode の二分木構造
-// - points_ : N次元点を配列 (vector) で持つ
+// - N と座標の型 Scalar (double または float) はテンプレートで指定
+// - ノードはポインタを持たない KdNode の配列 nodes_ で表す
+//   - perm_ : 点のインデックスを木の順に並べ替えた配列．部分範囲 [l, r) を中央 m = (l + r) / 2
+//     で std::nth_element により分割し，[l, m) を左，[m, r) を右の子とする
+//   - 点の数が bucket_size 以下になったら葉 (バケット) にする
+//   - 分割軸は部分範囲の点の座標の広がりが最大の軸
+// - coords_ : 木の順に並べた点の座標を軸ごとの配列 (SoA) で持つ
+//   葉の中の距離の2乗は KdLeafDistance で Scalar のまま計算する (float なら SIMD の幅が倍になる)
+// - 探索中は距離の2乗を比べ，sqrt は返す距離だけに使う
+// - KdSearchParams を渡す探索は best-bin-first による (1 + eps) 近似探索 (葉の数の上限つき)
+// - 点は入力の順のまま at(i) で参照する．vector のコピー・ムーブで渡した場合は
+//   points_ が持ち，ポインタで渡した場合は呼び出し側の配列をそのまま使う
+//   (座標の並び base_ と間隔 stride_，または点ごとの座標のポインタ ptrs_)
+//   MeshR・MeshL から点をコピーせずに作る関数は KdTreeMesh.hxx
+// - 構築は並列に行う: 大きな範囲の中央値の分割は標本から選んだ pivot による並列の分割で
+//   範囲を絞ってから nth_element し，上の階層の部分木はタスクとして並列に作る
 //
-template<int N>
+template<int N, class Scalar = double>
 class KdTree {
 
 public:
 
-  KdTree() : root_(nullptr) {};
+  typedef Eigen::Matrix<Scalar,N,1> Point;
+
+  enum { MAX_BUCKET = 32 };
+
+  // 並列に分割する範囲の点の数の下限
+  enum { PARALLEL_PARTITION_SIZE = 1 << 16 };
+  // 部分木をタスクとして作る範囲の点の数の下限
+  enum { PARALLEL_BUILD_SIZE = 4096 };
+  // 分割軸を選ぶときに座標の広がりを調べる点の数の上限
+  enum { SPREAD_SAMPLES = 256 };
+
+  KdTree(int bucket_size = 16) : base_(nullptr), stride_(N), n_(0) { setBucketSize(bucket_size); };
   ~KdTree(){ clear(); };
 
-  std::vector<Eigen::Vector<double,N> >& points() { return points_; };
-  KdNode* root() { return root_; };
+  // base_ が自分の points_ を指すことがあるのでコピーはしない (ムーブは base_ を付け替える)
+  KdTree(const KdTree&) = delete;
+  KdTree& operator=(const KdTree&) = delete;
+  KdTree(KdTree&& t) : base_(nullptr), stride_(N), n_(0), bucket_size_(t.bucket_size_) { *this = std::move(t); };
+  KdTree& operator=(KdTree&& t) {
+    if (this == &t) return *this;
+    bool own = !t.points_.empty() && (t.base_ == t.points_[0].data());
+    points_ = std::move(t.points_);
+    base_ = own ? points_[0].data() : t.base_;
+    stride_ = t.stride_;
+    ptrs_ = std::move(t.ptrs_);
+    n_ = t.n_;
+    perm_ = std::move(t.perm_);
+    nodes_ = std::move(t.nodes_);
+    coords_ = std::move(t.coords_);
+    bucket_size_ = t.bucket_size_;
+    t.clear();
+    return *this;
+  };
 
-  // kD-Tree の構築
-  void construct(const std::vector<Eigen::Vector<double,N> >& points) {
-    points_ = points;
+  // 点の数と i 番目 (入力の順) の点
+  int size() const { return n_; };
+  Eigen::Map<const Point> point(int i) const { return Eigen::Map<const Point>(at(i)); };
 
-    ///////// ここに構築用のコードを書く ///////////
+  // 木の順に並べた点のインデックス
+  const std::vector<int>& perm() const { return perm_; };
 
+  // ノードの配列 (nodes()[0] が根)
+  const std::vector<KdNode>& nodes() const { return nodes_; };
 
+  // 葉の点の数の上限 (1 ... MAX_BUCKET)．construct() の前に設定する
+  void setBucketSize(int b) { bucket_size_ = std::max(1, std::min((int) MAX_BUCKET, b)); };
+  int bucketSize() const { return bucket_size_; };
 
-    ///////////////////////////////////////////
+  // kD-Tree の構築 (点をコピーする)
+  void construct(const std::vector<Point>& points,
+                 ThreadPool& pool = ThreadPool::instance()) {
+    std::vector<Point> copy(points);
+    construct(std::move(copy), pool);
   };
 
-  // 最近傍点の探索: 最近傍点の点のインデックスを返す
-  // q: クエリ点
-  // min_dis: 最短距離
-  int nnSearch(const Eigen::Vector<double,N>& q, double* min_dis = nullptr) {
+  // kD-Tree の構築 (点をムーブして持つ．コピーしない)
+  void construct(std::vector<Point>&& points,
+                 ThreadPool& pool = ThreadPool::instance()) {
+    points_ = std::move(points);
+    std::vector<const Scalar*>().swap(ptrs_);
+    build(points_.empty() ? nullptr : points_[0].data(), sizeof(Point) / sizeof(Scalar),
+          (int) points_.size(), pool);
+  };
 
-    int index; // 最近傍点のインデックス
+  // kD-Tree の構築 (points[0 ... n-1] を参照する．木を使う間 points を保持しておくこと)
+  void construct(const Point* points, int n,
+                 ThreadPool& pool = ThreadPool::instance()) {
+    construct((n > 0) ? points[0].data() : nullptr, n, sizeof(Point) / sizeof(Scalar), pool);
+  };
 
-    //////// ここに最近傍点探索のコードを書く ////////
+  //
+  // kD-Tree の構築 (座標の配列を参照する．木を使う間 coords を保持しておくこと)
+  // i 番目の点の座標は coords[stride * i ... stride * i + N - 1] (MeshR::points() なら stride = 3)
+  //
+  void construct(const Scalar* coords, int n, int stride,
+                 ThreadPool& pool = ThreadPool::instance()) {
+    std::vector<Point>().swap(points_);
+    std::vector<const Scalar*>().swap(ptrs_);
+    build(coords, stride, n, pool);
+  };
 
+  //
+  // kD-Tree の構築 (点ごとの座標のポインタを参照する．木を使う間 座標を保持しておくこと)
+  // i 番目の点の座標は ptrs[i][0 ... N-1] (MeshL の頂点のように点が連続していない場合)
+  //
+  void construct(std::vector<const Scalar*>&& ptrs,
+                 ThreadPool& pool = ThreadPool::instance()) {
+    std::vector<Point>().swap(points_);
+    ptrs_ = std::move(ptrs);
+    build(nullptr, N, (int) ptrs_.size(), pool);
+  };
 
+  // 最近傍点の探索: 最近傍点の点のインデックスを返す (点がなければ -1)
+  // q: クエリ点
+  // min_dis: 最短距離
+  int nnSearch(const Point& q, double* min_dis = nullptr) {
 
-    ///////////////////////////////////////////
+    int index = -1; // 最近傍点のインデックス
+    double min_d2 = std::numeric_limits<double>::max();
+    if (!nodes_.empty()) nnSearchNode(q, 0, index, min_d2);
+    if (min_dis != nullptr) *min_dis = (index >= 0) ? std::sqrt(min_d2) : min_d2;
     return index;
   };
 
   // K近傍点の探索: k個の近傍点のインデックス列を返す（インデックス列は距離の近い順に並んでいる必要がある）
   // q: クエリ点
   // k: 近傍点の数
-  std::vector<int> knnSearch(const Eigen::Vector<double,N>& q, int k) {
+  std::vector<int> knnSearch(const Point& q, int k) {
 
     std::vector<int> indices; // K個の近傍点のインデックス
+    if ((k <= 0) || nodes_.empty()) return indices;
 
-    ////////// K近傍点探索のコードを書く ///////////
-
+    std::vector<std::pair<double,int> > buf(std::min(k, n_));
+    KnnHeap heap(buf.data(), (int) buf.size());
+    knnSearchNode(q, 0, heap);
+    heap.sort();
 
+    indices.resize(heap.size);
+    for (int i = 0; i < heap.size; ++i) indices[i] = heap.data[i].second;
+    return indices;
+  };
 
-    ///////////////////////////////////////////
+  //
+  // 近似 K近傍点の探索 (best-bin-first)
+  // - ノードを領域までの距離の下限の小さい順に優先度付きキューから取り出して調べる
+  // - 下限の (1 + eps) 倍が k 番目の距離以上になるか，葉の数が max_leaves に達したら打ち切る
+  // - stats を渡すと辿ったノードの数などを返す
+  //
+  std::vector<int> knnSearch(const Point& q, int k, const KdSearchParams& params,
+                             KdSearchStats* stats = nullptr) {
+
+    std::vector<int> indices;
+    KdSearchStats st;
+    if ((k > 0) && !nodes_.empty()) {
+      std::vector<std::pair<double,int> > buf(std::min(k, n_));
+      KnnHeap heap(buf.data(), (int) buf.size());
+      BbfQueue bbf;
+      annSearchNode(q, params, heap, bbf, st);
+      heap.sort();
+
+      indices.resize(heap.size);
+      for (int i = 0; i < heap.size; ++i) indices[i] = heap.data[i].second;
+    }
+    if (stats != nullptr) *stats = st;
     return indices;
   };
 
+  // 近似最近傍点の探索 (knnSearch の k = 1)
+  int nnSearch(const Point& q, const KdSearchParams& params,
+               double* min_dis = nullptr, KdSearchStats* stats = nullptr) {
+
+    int index = -1;
+    double min_d2 = std::numeric_limits<double>::max();
+    KdSearchStats st;
+    if (!nodes_.empty()) {
+      std::pair<double,int> buf;
+      KnnHeap heap(&buf, 1);
+      BbfQueue bbf;
+      annSearchNode(q, params, heap, bbf, st);
+      index = buf.second; min_d2 = buf.first;
+    }
+    if (min_dis != nullptr) *min_dis = (index >= 0) ? std::sqrt(min_d2) : min_d2;
+    if (stats != nullptr) *stats = st;
+    return index;
+  };
+
   // 半径探索: 半径r内の近傍点のインデックス列を返す
   // q: クエリ点
   // r: 半径
-  std::vector<int> radiusSearch(const Eigen::Vector<double,N>& q, double r) {
+  std::vector<int> radiusSearch(const Point& q, double r) {
 
     std::vector<int> indices; // 半径内の近傍点のインデックス
+    if ((r < .0) || nodes_.empty()) return indices;
 
-    /////////// 半径探索のコードを書く ////////////
+    radiusSearchNode(q, r * r, 0, [&indices](int i, double) { indices.push_back(i); return true; });
+    return indices;
+  };
 
+  //
+  // 半径探索 (ビジター): 半径r内の点ごとに visitor(点のインデックス, 距離の2乗) を呼ぶ
+  // - 結果の配列を作らないので，数や和だけが欲しい場合に確保なしで使える
+  // - visitor が false を返すとその場で探索を打ち切る (点の順序は決まっていない)
+  // - 最後まで探索したら true，打ち切ったら false を返す
+  //
+  template <class Visitor>
+  bool radiusSearch(const Point& q, double r, Visitor&& visitor) const {
+    if ((r < .0) || nodes_.empty()) return true;
+    return radiusSearchNode(q, r * r, 0, visitor);
+  };
 
+  //
+  // K近傍点の一括探索: queries[i] の近傍点を CSR 形式で出力する
+  // - queries[i] の結果は indices[offsets[i] ... offsets[i+1]-1] (距離の近い順)
+  // - dists を渡すと同じ位置に距離を出力する
+  // - 出力の配列は大きさを合わせるだけなので，同じ配列を使い回せば確保は起きない
+  // - クエリを区間に分けてスレッドプールで並列に処理し，区間ごとのヒープを使い回す
+  //
+  void knnSearchBatch(const std::vector<Point>& queries, int k,
+                      std::vector<int>& offsets, std::vector<int>& indices,
+                      std::vector<double>* dists = nullptr,
+                      ThreadPool& pool = ThreadPool::instance()) {
+    int n_q = (int) queries.size(), kk = std::max(0, std::min(k, n_));
+    offsets.resize(n_q + 1);
+    for (int i = 0; i <= n_q; ++i) offsets[i] = i * kk;
+    indices.resize((size_t) n_q * kk);
+    if (dists != nullptr) dists->resize((size_t) n_q * kk);
+    if ((kk == 0) || (n_q == 0)) return;
+
+    int n_chunks = std::min(n_q, 8 * pool.size());
+    std::vector<std::pair<double,int> > buf((size_t) n_chunks * kk);
+    parallelFor(pool, 0, n_chunks, 1, [&](int c) {
+        KnnHeap heap(&buf[(size_t) c * kk], kk);
+        for (int i = chunkBegin(n_q, n_chunks, c); i < chunkBegin(n_q, n_chunks, c + 1); ++i) {
+          heap.size = 0;
+          knnSearchNode(queries[i], 0, heap);
+          heap.sort();
+          for (int j = 0; j < kk; ++j) {
+            indices[(size_t) i * kk + j] = heap.data[j].second;
+            if (dists != nullptr) (*dists)[(size_t) i * kk + j] = std::sqrt(heap.data[j].first);
+          }
+        } });
+  };
 
-    ///////////////////////////////////////////
-    return indices;
+  //
+  // 近似 K近傍点の一括探索 (出力は knnSearchBatch と同じ CSR 形式)
+  // - stats を渡すとクエリごとの統計を出力する
+  // - 優先度付きキューも区間ごとに使い回す
+  //
+  void knnSearchBatch(const std::vector<Point>& queries, int k,
+                      const KdSearchParams& params,
+                      std::vector<int>& offsets, std::vector<int>& indices,
+                      std::vector<double>* dists = nullptr,
+                      std::vector<KdSearchStats>* stats = nullptr,
+                      ThreadPool& pool = ThreadPool::instance()) {
+    int n_q = (int) queries.size(), kk = std::max(0, std::min(k, n_));
+    offsets.resize(n_q + 1);
+    for (int i = 0; i <= n_q; ++i) offsets[i] = i * kk;
+    indices.resize((size_t) n_q * kk);
+    if (dists != nullptr) dists->resize((size_t) n_q * kk);
+    if (stats != nullptr) stats->assign(n_q, KdSearchStats());
+    if ((kk == 0) || (n_q == 0)) return;
+
+    int n_chunks = std::min(n_q, 8 * pool.size());
+    std::vector<std::pair<double,int> > buf((size_t) n_chunks * kk);
+    parallelFor(pool, 0, n_chunks, 1, [&](int c) {
+        KnnHeap heap(&buf[(size_t) c * kk], kk);
+        BbfQueue bbf;
+        for (int i = chunkBegin(n_q, n_chunks, c); i < chunkBegin(n_q, n_chunks, c + 1); ++i) {
+          KdSearchStats st;
+          heap.size = 0;
+          annSearchNode(queries[i], params, heap, bbf, st);
+          heap.sort();
+          for (int j = 0; j < kk; ++j) {
+            indices[(size_t) i * kk + j] = heap.data[j].second;
+            if (dists != nullptr) (*dists)[(size_t) i * kk + j] = std::sqrt(heap.data[j].first);
+          }
+          if (stats != nullptr) (*stats)[i] = st;
+        } });
+  };
+
+  //
+  // 半径探索の一括処理: queries[i] の半径 r 内の点を CSR 形式で出力する
+  // - queries[i] の結果は indices[offsets[i] ... offsets[i+1]-1] (順不同)
+  // - dists を渡すと同じ位置に距離を出力する
+  // - 1 回目に数だけ数えて offsets を決め，2 回目に書き込む (途中の確保はない)
+  //
+  void radiusSearchBatch(const std::vector<Point>& queries, double r,
+                         std::vector<int>& offsets, std::vector<int>& indices,
+                         std::vector<double>* dists = nullptr,
+                         ThreadPool& pool = ThreadPool::instance()) {
+    int n_q = (int) queries.size();
+    offsets.assign(n_q + 1, 0);
+    if ((r < .0) || nodes_.empty()) {
+      indices.clear();
+      if (dists != nullptr) dists->clear();
+      return;
+    }
+    double r2 = r * r;
+
+    parallelFor(pool, 0, n_q, 64, [&](int i) {
+        int cnt = 0;
+        radiusSearchNode(queries[i], r2, 0, [&cnt](int, double) { ++cnt; return true; });
+        offsets[i + 1] = cnt; });
+    for (int i = 0; i < n_q; ++i) offsets[i + 1] += offsets[i];
+
+    indices.resize(offsets[n_q]);
+    if (dists != nullptr) dists->resize(offsets[n_q]);
+    parallelFor(pool, 0, n_q, 64, [&](int i) {
+        int j = offsets[i];
+        radiusSearchNode(queries[i], r2, 0, [&](int idx, double d2) {
+            indices[j] = idx;
+            if (dists != nullptr) (*dists)[j] = std::sqrt(d2);
+            ++j;
+            return true; }); });
   };
 
 private:
 
   // kD-Tree 削除
   void clear() {
-    clearChild(root_);
-    root_ = nullptr;
+    nodes_.clear();
+    perm_.clear();
+    coords_.clear();
     points_.clear();
+    ptrs_.clear();
+    base_ = nullptr;
+    n_ = 0;
+  };
+
+  // i 番目の点の座標
+  const Scalar* at(int i) const { return ptrs_.empty() ? base_ + (size_t) stride_ * i : ptrs_[i]; };
+
+  // n 点の木を作る (ptrs_ が空なら点の座標は base[stride * i ...])
+  void build(const Scalar* base, int stride, int n, ThreadPool& pool) {
+    base_ = base;
+    stride_ = stride;
+    n_ = n;
+    perm_.resize(n);
+    parallelForRange(pool, 0, n, PARALLEL_PARTITION_SIZE, [this](int b, int e) {
+        for (int i = b; i < e; ++i) perm_[i] = i; });
+
+    // 部分範囲の大きさは点の数だけで決まるので，ノードの番号を先に決めて並列に埋められる
+    node_count_.clear();
+    nodes_.assign(n > 0 ? countNodes(n) : 0, KdNode());
+    std::vector<int> tmp((n >= PARALLEL_PARTITION_SIZE) ? n : 0);
+    if (n > 0) buildNode(0, 0, n, 0, pool, tmp);
+    node_count_.clear();
+
+    coords_.resize((size_t) N * n);
+    parallelForRange(pool, 0, n, PARALLEL_PARTITION_SIZE, [this, n](int b, int e) {
+        for (int d = 0; d < N; ++d)
+          for (int i = b; i < e; ++i) coords_[(size_t) d * n + i] = at(perm_[i])[d]; });
+  };
+
+  // n 点の部分木のノード数 (node_count_ に記録する．同じ深さの範囲の大きさは高々 2 通り)
+  int countNodes(int n) {
+    auto it = node_count_.find(n);
+    if (it != node_count_.end()) return it->second;
+    int c = (n <= bucket_size_) ? 1 : 1 + countNodes(n >> 1) + countNodes(n - (n >> 1));
+    node_count_[n] = c;
+    return c;
+  };
+
+  // 部分範囲 [l, r) をノード id とし，座標の広がりが最大の軸の中央値で分割する
+  void buildNode(int id, int l, int r, int depth, ThreadPool& pool, std::vector<int>& tmp) {
+    if (r - l <= bucket_size_) {
+      nodes_[id].setLeaf(l, r);
+      return;
+    }
+
+    int axis = spreadAxis(l, r), m = (l + r) >> 1;
+    select(l, m, r, axis, pool, tmp);
+    nodes_[id].setSplit(axis, at(perm_[m])[axis], l, r);
+    int left = id + 1, right = id + 1 + node_count_.find(m - l)->second;
+    nodes_[id].setRight(right);
+
+    if ((pool.size() > 1) && (r - l >= PARALLEL_BUILD_SIZE)) {
+      TaskGroup tg(pool);
+      tg.run([this, left, l, m, depth, &pool, &tmp]() { buildNode(left, l, m, depth + 1, pool, tmp); });
+      buildNode(right, m, r, depth + 1, pool, tmp);
+      tg.wait();
+    } else {
+      buildNode(left, l, m, depth + 1, pool, tmp);
+      buildNode(right, m, r, depth + 1, pool, tmp);
+    }
+  };
+
+  //
+  // perm_[l, r) の点の座標の広がり (最大 - 最小) が最大の軸
+  // 大きな範囲は等間隔の SPREAD_SAMPLES 個の点で見積もる (軸を選ぶだけなので厳密でなくてよい)
+  //
+  int spreadAxis(int l, int r) const {
+    int step = std::max(1, (r - l) / SPREAD_SAMPLES);
+    Point lo = Point::Constant(std::numeric_limits<Scalar>::max());
+    Point hi = Point::Constant(std::numeric_limits<Scalar>::lowest());
+    for (int i = l; i < r; i += step) {
+      const Scalar* p = at(perm_[i]);
+      for (int d = 0; d < N; ++d) {
+        lo[d] = std::min(lo[d], p[d]);
+        hi[d] = std::max(hi[d], p[d]);
+      }
+    }
+    int axis;
+    (hi - lo).maxCoeff(&axis);
+    return axis;
+  };
+
+  //
+  // perm_[l, r) を軸 axis の座標で m 番目が中央値になるよう並べ替える (nth_element と同じ)
+  // - 大きな範囲は標本の中央値を pivot として並列に 2 分割し，m を含む側に範囲を絞る
+  // - 重複した座標が多く分割が進まない場合は，そのまま nth_element に任せる
+  //
+  void select(int l, int m, int r, int axis, ThreadPool& pool, std::vector<int>& tmp) {
+    auto less = [this, axis](int a, int b) { return at(a)[axis] < at(b)[axis]; };
+    while ((pool.size() > 1) && (r - l >= PARALLEL_PARTITION_SIZE)) {
+      const int n_samples = 255;
+      Scalar sample[n_samples];
+      for (int i = 0; i < n_samples; ++i)
+        sample[i] = at(perm_[l + (int) ((long long) (r - l) * (2 * i + 1) / (2 * n_samples))])[axis];
+      // m の位置に相当する標本を pivot にする
+      int k = (int) ((long long) (m - l) * n_samples / (r - l));
+      std::nth_element(sample, sample + k, sample + n_samples);
+
+      int b = partition(l, r, axis, sample[k], pool, tmp);
+      if ((b == l) || (b == r)) break;
+      if (m < b) r = b;
+      else l = b;
+    }
+    std::nth_element(perm_.begin() + l, perm_.begin() + m, perm_.begin() + r, less);
+  };
+
+  //
+  // perm_[l, r) を軸 axis の座標が pivot 未満のものと以上のものに分け，境界を返す
+  // ブロックごとに数えて書き込み位置を決め，tmp に並列に書き出してから戻す
+  //
+  int partition(int l, int r, int axis, Scalar pivot, ThreadPool& pool, std::vector<int>& tmp) {
+    int n_blocks = 4 * pool.size(), len = (r - l + n_blocks - 1) / n_blocks;
+    std::vector<int> n_less(n_blocks, 0), off_less(n_blocks), off_ge(n_blocks);
+    parallelFor(pool, 0, n_blocks, 1, [&](int c) {
+        int b = l + c * len, e = std::min(r, b + len), cnt = 0;
+        for (int i = b; i < e; ++i) if (at(perm_[i])[axis] < pivot) ++cnt;
+        n_less[c] = cnt; });
+
+    int total = 0;
+    for (int c = 0; c < n_blocks; ++c) { off_less[c] = l + total; total += n_less[c]; }
+    int ge = l + total;
+    for (int c = 0; c < n_blocks; ++c) {
+      int b = l + c * len, e = std::min(r, b + len);
+      off_ge[c] = ge;
+      ge += std::max(0, e - b) - n_less[c];
+    }
+
+    parallelFor(pool, 0, n_blocks, 1, [&](int c) {
+        int b = l + c * len, e = std::min(r, b + len), il = off_less[c], ig = off_ge[c];
+        for (int i = b; i < e; ++i) {
+          int p = perm_[i];
+          if (at(p)[axis] < pivot) tmp[il++] = p;
+          else tmp[ig++] = p;
+        } });
+    parallelForRange(pool, l, r, PARALLEL_PARTITION_SIZE / 4, [this, &tmp](int b, int e) {
+        std::copy(tmp.begin() + b, tmp.begin() + e, perm_.begin() + b); });
+    return l + total;
+  };
+
+  // 葉 nd の点とクエリ点との距離の2乗を d2[] に求める
+  void leafDistances(const KdNode& nd, const Point& q, Scalar* d2) const {
+    KdLeafDistance<N, Scalar>::compute(&coords_[nd.begin()], perm_.size(), nd.end() - nd.begin(), q.data(), d2);
+  };
+
+  // nnSearch の再帰関数
+  void nnSearchNode(const Point& q, int id, int& index, double& min_d2) {
+    const KdNode& nd = nodes_[id];
+    if (nd.isLeaf()) {
+      Scalar d2[MAX_BUCKET];
+      leafDistances(nd, q, d2);
+      for (int i = 0; i < nd.end() - nd.begin(); ++i)
+        if (d2[i] < min_d2) { min_d2 = d2[i]; index = perm_[nd.begin() + i]; }
+      return;
+    }
+
+    // クエリ点のある側を先に探索し，分割面までの距離が最短距離より近ければ反対側も探索する
+    double diff = q[nd.axis()] - nd.split();
+    int near_id = (diff < .0) ? id + 1 : nd.right(), far_id = (diff < .0) ? nd.right() : id + 1;
+    nnSearchNode(q, near_id, index, min_d2);
+    if (diff * diff < min_d2) nnSearchNode(q, far_id, index, min_d2);
   };
 
-  // kD-Tree 削除 再帰関数
-  void clearChild(KdNode* node) {
-    if (node == nullptr) return;
-    clearChild(node->child(0));
-    clearChild(node->child(1));
-    delete node;
+  // DynamicKdTree は各木の探索関数を直接使う
+  template <int M, class S> friend class DynamicKdTree;
+
+  //
+  // K近傍点の探索に使う (距離の2乗, インデックス) の最大ヒープ
+  // - 呼び出し側が確保した k 個の配列 data の上に作る (先頭が k 個の中で最も遠い点)
+  //
+  struct KnnHeap {
+    std::pair<double,int>* data;
+    int size;
+    int k;
+
+    KnnHeap(std::pair<double,int>* d, int kk) : data(d), size(0), k(kk) {};
+
+    bool full() const { return (size == k); };
+    double top() const { return data[0].first; };
+
+    void push(double d2, int i) {
+      if (size < k) {
+        data[size++] = std::make_pair(d2, i);
+        std::push_heap(data, data + size);
+      } else if (d2 < data[0].first) {
+        std::pop_heap(data, data + size);
+        data[size - 1] = std::make_pair(d2, i);
+        std::push_heap(data, data + size);
+      }
+    };
+
+    // 距離の近い順に並べる (以後ヒープではなくなる)
+    void sort() { std::sort_heap(data, data + size); };
   };
 
-  // 2点間の距離
-  double distance(const Eigen::Vector<double,N>& p, const Eigen::Vector<double,N>& q) {
-    return (p - q).norm();
+  // i 番目の区間の先頭 (n 個を n_chunks 個の区間に分ける)
+  static int chunkBegin(int n, int n_chunks, int i) { return (int) ((long long) n * i / n_chunks); };
+
+  // knnSearch の再帰関数
+  void knnSearchNode(const Point& q, int id, KnnHeap& heap) const {
+    knnSearchNode(q, id, heap, [](int i) { return i; });
+  };
+
+  //
+  // knnSearch の再帰関数 (ヒープに入れるインデックスを map(点のインデックス) で変換する)
+  // map が負を返す点は候補から除く (DynamicKdTree が削除済みの点を除き，通し番号に変換するのに使う)
+  //
+  template <class Map>
+  void knnSearchNode(const Point& q, int id, KnnHeap& heap, const Map& map) const {
+    const KdNode& nd = nodes_[id];
+    if (nd.isLeaf()) {
+      Scalar d2[MAX_BUCKET];
+      leafDistances(nd, q, d2);
+      for (int i = 0; i < nd.end() - nd.begin(); ++i) {
+        if (heap.full() && (d2[i] >= heap.top())) continue;
+        int m = map(perm_[nd.begin() + i]);
+        if (m >= 0) heap.push(d2[i], m);
+      }
+      return;
+    }
+
+    double diff = q[nd.axis()] - nd.split();
+    int near_id = (diff < .0) ? id + 1 : nd.right(), far_id = (diff < .0) ? nd.right() : id + 1;
+    knnSearchNode(q, near_id, heap, map);
+    if (!heap.full() || (diff * diff < heap.top())) knnSearchNode(q, far_id, heap, map);
+  };
+
+  //
+  // best-bin-first 探索の優先度付きキュー
+  // - キーはノードの領域までの距離の2乗の下限 (小さい順に取り出す)
+  // - キューの id は追加の通し番号で，node_ids[id] がノード番号，
+  //   offsets[N * id ... ] が領域までの軸ごとの差
+  //
+  struct BbfQueue {
+    PriorityQueue<PQNoded> pq;
+    std::vector<int> node_ids;
+    std::vector<double> offsets;
+
+    void reset() { pq.reset(); node_ids.clear(); offsets.clear(); };
+
+    void push(int id, double bound, const double* off) {
+      PQNoded nd((int) node_ids.size(), bound);
+      node_ids.push_back(id);
+      offsets.insert(offsets.end(), off, off + N);
+      pq.insert(nd);
+    };
+  };
+
+  //
+  // 近似 K近傍点の探索 (best-bin-first)
+  // 取り出したノードから近い方の子を葉まで辿り，遠い方の子を領域までの距離の2乗で
+  // キューに入れる．距離は分割軸の差だけを入れ替えて増分で求める (Arya & Mount)
+  //
+  void annSearchNode(const Point& q, const KdSearchParams& params,
+                     KnnHeap& heap, BbfQueue& bbf, KdSearchStats& stats) const {
+    double f = (1.0 + params.eps) * (1.0 + params.eps);
+    double off[N];
+    for (int j = 0; j < N; ++j) off[j] = .0;
+    bbf.reset();
+    bbf.push(0, .0, off);
+    while (!bbf.pq.empty()) {
+      double bound = bbf.pq.top().key();
+      int e = bbf.pq.top().id(), id = bbf.node_ids[e];
+      bbf.pq.pop();
+      if (heap.full()) {
+        if (bound * f >= heap.top()) break;
+        if ((params.max_leaves > 0) && (stats.leaves >= params.max_leaves)) break;
+      }
+
+      for (int j = 0; j < N; ++j) off[j] = bbf.offsets[N * e + j];
+      while (!nodes_[id].isLeaf()) {
+        const KdNode& nd = nodes_[id];
+        ++stats.nodes;
+        int axis = nd.axis();
+        double diff = q[axis] - nd.split();
+        int near_id = (diff < .0) ? id + 1 : nd.right(), far_id = (diff < .0) ? nd.right() : id + 1;
+        double b = bound - off[axis] * off[axis] + diff * diff;
+        if (!heap.full() || (b * f < heap.top())) {
+          double old = off[axis];
+          off[axis] = diff;
+          bbf.push(far_id, b, off);
+          off[axis] = old;
+        }
+        id = near_id;
+      }
+
+      const KdNode& nd = nodes_[id];
+      ++stats.nodes; ++stats.leaves; stats.points += nd.end() - nd.begin();
+      Scalar d2[MAX_BUCKET];
+      leafDistances(nd, q, d2);
+      for (int i = 0; i < nd.end() - nd.begin(); ++i)
+        if (!heap.full() || (d2[i] < heap.top())) heap.push(d2[i], perm_[nd.begin() + i]);
+    }
+  };
+
+  //
+  // radiusSearch の再帰関数 (r2: 半径の2乗)
+  // 半径内の点ごとに f(点のインデックス, 距離の2乗) を呼び，f が false を返したら打ち切る
+  // 打ち切った場合は false を返す
+  //
+  template <class Func>
+  bool radiusSearchNode(const Point& q, double r2, int id, Func&& f) const {
+    const KdNode& nd = nodes_[id];
+    if (nd.isLeaf()) {
+      Scalar d2[MAX_BUCKET];
+      leafDistances(nd, q, d2);
+      for (int i = 0; i < nd.end() - nd.begin(); ++i)
+        if ((d2[i] <= r2) && !f(perm_[nd.begin() + i], d2[i])) return false;
+      return true;
+    }
+
+    double diff = q[nd.axis()] - nd.split();
+    if (((diff < .0) || (diff * diff <= r2)) && !radiusSearchNode(q, r2, id + 1, f)) return false;
+    if (((diff >= .0) || (diff * diff <= r2)) && !radiusSearchNode(q, r2, nd.right(), f)) return false;
+    return true;
   };
 
   //
   // メンバ変数
   //
 
-  KdNode* root_; // KdNode 根ノード
-  std::vector<Eigen::Vector<double,N> > points_; // 点の vector 配列
+  std::vector<Point> points_;       // 点の vector 配列 (コピー・ムーブで渡した場合)
+  const Scalar* base_;              // 点の座標の並び (points_ または呼び出し側の配列)
+  int stride_;                      // base_ の点の間隔 (Scalar の数)
+  std::vector<const Scalar*> ptrs_; // 点ごとの座標のポインタ (空でなければ base_ より優先)
+  int n_;                           // 点の数
+  std::vector<int> perm_;      // 木の順に並べた点のインデックス
+  std::vector<KdNode> nodes_;  // ノードの配列
+  std::vector<Scalar> coords_; // 木の順の点の座標 (軸 d の i 番目は coords_[d * n + i])
+  int bucket_size_;            // 葉の点の数の上限
+  std::map<int,int> node_count_; // 構築中: 部分範囲の大きさ -> 部分木のノード数
 };
 
 #endif // __KDTREE_HXX__
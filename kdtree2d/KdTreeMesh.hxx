@@ -0,0 +1,53 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: KdTreeMesh.hxx 2026/10/18 19:48:21 kanai Exp $
+//
+// Copyright (c) 2026 Takashi Kanai
+// Released under the MIT license
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef __KDTREEMESH_HXX__
+#define __KDTREEMESH_HXX__
+
+#include <vector>
+using namespace std;
+
+#include "MeshL.hxx"
+#include "MeshR.hxx"
+#include "KdTree.hxx"
+
+//
+// メッシュの頂点から点をコピーせずに 3次元 kD-Tree を作る
+// - 木は頂点の座標を直接参照するので，木を使う間はメッシュの頂点を追加・削除・移動しないこと
+// - 木が持つのは SoA の座標 coords_ と並べ替え perm_ だけなので，
+//   点の配列にコピーしてから作る場合に比べてメモリはおよそ半分になる
+//
+
+//
+// MeshR の頂点 (points(): float の xyz の並び) から作る
+// 点のインデックスは MeshR の頂点番号
+//
+inline void constructKdTree(KdTree<3, float>& kdtree, MeshR& mesh,
+                            ThreadPool& pool = ThreadPool::instance()) {
+  kdtree.construct(mesh.points().data(), (int) mesh.numPoints(), 3, pool);
+}
+
+//
+// MeshL の頂点 (vertices()) から作る
+// 点のインデックスは vertices() の順．vertices を渡すとインデックスの順の頂点を返す
+//
+inline void constructKdTree(KdTree<3, double>& kdtree, MeshL& mesh,
+                            std::vector<VertexL*>* vertices = nullptr,
+                            ThreadPool& pool = ThreadPool::instance()) {
+  std::vector<const double*> ptrs;
+  ptrs.reserve(mesh.vertices().size());
+  if (vertices != nullptr) vertices->clear();
+  for (auto vt : mesh.vertices()) {
+    ptrs.push_back(vt->point().data());
+    if (vertices != nullptr) vertices->push_back(vt);
+  }
+  kdtree.construct(std::move(ptrs), pool);
+}
+
+#endif // __KDTREEMESH_HXX__
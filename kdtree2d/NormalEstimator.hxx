@@ -0,0 +1,223 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: NormalEstimator.hxx 2026/10/18 20:31:44 kanai Exp $
+//
+// Copyright (c) 2026 Takashi Kanai
+// Released under the MIT license
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef __NORMALESTIMATOR_HXX__
+#define __NORMALESTIMATOR_HXX__
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+using namespace std;
+
+#include "myEigen.hxx"
+#include <Eigen/Eigenvalues>
+#include "ThreadPool.hxx"
+#include "pq.h"
+#include "KdTreeMesh.hxx"
+
+//
+// 点群の法線の推定
+// - 各点の K近傍点を KdTree<3, Scalar>::knnSearchBatch でブロックごとに一括探索し，
+//   (クエリは木の順 perm() に並べる．続くクエリが同じ葉・近くのノードを辿るのでキャッシュに乗る)
+//   近傍点の共分散行列の最小固有値の固有ベクトルを法線とする
+//   (3x3 の SelfAdjointEigenSolver::computeDirect による閉じた形の固有値分解，点ごとに並列)
+// - 向きは K近傍グラフ上で伝播する (Hoppe et al. 1992): 重み 1 - |n_i・n_j| の最小全域木を
+//   Prim 法で辿り，親の法線と逆向きなら反転する．連結成分ごとに z 座標が最大の点から始め，
+//   その点の法線は +z 側に向ける
+// - 曲率の目安として λ0 / (λ0 + λ1 + λ2) (surface variation) も求める
+//
+template <class Scalar = double>
+class NormalEstimator {
+
+public:
+
+  typedef Eigen::Matrix<Scalar,3,1> Point;
+
+  // 近傍を一括探索するクエリの数
+  enum { BLOCK_SIZE = 1 << 16 };
+
+  NormalEstimator(int k = 16) : isOrient_(true) { setK(k); };
+  ~NormalEstimator() {};
+
+  // 近傍点の数 (自分自身を含む)
+  void setK(int k) { k_ = std::max(3, k); };
+  int k() const { return k_; };
+
+  // 向きをそろえるかどうか
+  void setOrient(bool f) { isOrient_ = f; };
+  bool isOrient() const { return isOrient_; };
+
+  // 点ごとの surface variation (estimate() の後)
+  const std::vector<Scalar>& curvatures() const { return curvatures_; };
+
+  //
+  // kdtree の点の単位法線 normals[i] (点のインデックスの順) を求める
+  //
+  void estimate(KdTree<3, Scalar>& kdtree, std::vector<Point>& normals,
+                ThreadPool& pool = ThreadPool::instance()) {
+    int n = kdtree.size();
+    normals.resize(n);
+    curvatures_.resize(n);
+    if (n == 0) return;
+
+    int kk = std::min(k_, n);
+    neighbors_.resize((size_t) n * kk);
+    std::vector<Point> queries;
+    std::vector<int> offsets, indices;
+    const std::vector<int>& perm = kdtree.perm();
+    for (int b = 0; b < n; b += BLOCK_SIZE) {
+      int e = std::min(n, b + BLOCK_SIZE);
+      queries.resize(e - b);
+      for (int t = b; t < e; ++t) queries[t - b] = kdtree.point(perm[t]);
+      kdtree.knnSearchBatch(queries, kk, offsets, indices, nullptr, pool);
+
+      parallelForRange(pool, b, e, 1024, [&](int bb, int ee) {
+          for (int t = bb; t < ee; ++t) {
+            int i = perm[t];
+            const int* nb = &indices[(size_t) (t - b) * kk];
+            std::copy(nb, nb + kk, &neighbors_[(size_t) i * kk]);
+            normals[i] = pcaNormal(kdtree, nb, kk, curvatures_[i]);
+          } });
+    }
+
+    if (isOrient()) orient(kdtree, kk, normals);
+  };
+
+private:
+
+  //
+  // 近傍点 nb[0 ... kk-1] の共分散行列の最小固有値の固有ベクトル
+  // float の点でも桁落ちしないよう重心を引いてから double で計算する
+  //
+  static Point pcaNormal(KdTree<3, Scalar>& kdtree, const int* nb, int kk, Scalar& curvature) {
+    Eigen::Vector3d c = Eigen::Vector3d::Zero();
+    for (int j = 0; j < kk; ++j) c += kdtree.point(nb[j]).template cast<double>();
+    c /= (double) kk;
+
+    Eigen::Matrix3d cov = Eigen::Matrix3d::Zero();
+    for (int j = 0; j < kk; ++j) {
+      Eigen::Vector3d d = kdtree.point(nb[j]).template cast<double>() - c;
+      cov += d * d.transpose();
+    }
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> es;
+    es.computeDirect(cov);
+    const Eigen::Vector3d& ev = es.eigenvalues(); // 昇順
+    double sum = ev[0] + ev[1] + ev[2];
+    curvature = (Scalar) ((sum > .0) ? ev[0] / sum : .0);
+    return es.eigenvectors().col(0).template cast<Scalar>();
+  };
+
+  //
+  // K近傍グラフ (neighbors_ とその逆向きの辺) の最小全域木で法線の向きをそろえる
+  //
+  void orient(KdTree<3, Scalar>& kdtree, int kk, std::vector<Point>& normals) {
+    int n = (int) normals.size();
+
+    // 逆向きの辺 (j が i の近傍なら i を j の入辺に入れる) の CSR
+    std::vector<int> in_off(n + 1, 0), in_idx((size_t) n * kk);
+    for (size_t e = 0; e < neighbors_.size(); ++e) ++in_off[neighbors_[e] + 1];
+    for (int i = 0; i < n; ++i) in_off[i + 1] += in_off[i];
+    {
+      std::vector<int> pos(in_off.begin(), in_off.end() - 1);
+      for (int i = 0; i < n; ++i)
+        for (int j = 0; j < kk; ++j) in_idx[pos[neighbors_[(size_t) i * kk + j]]++] = i;
+    }
+
+    // 連結成分の始点の候補: z 座標の大きい順
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&kdtree](int a, int b) { return kdtree.point(a).z() > kdtree.point(b).z(); });
+
+    // state: 0 未到達, 1 キューの中, 2 確定
+    std::vector<char> state(n, 0);
+    std::vector<int> parent(n, -1);
+    PriorityQueue<PQNoded> pq;
+    pq.init(n);
+
+    auto relax = [&](int u, int v) {
+      if (state[v] == 2) return;
+      double w = 1.0 - std::fabs((double) normals[u].dot(normals[v]));
+      PQNoded nd(v, w);
+      if (state[v] == 0) {
+        state[v] = 1;
+        parent[v] = u;
+        pq.insert(nd);
+      } else if (w < pq.node(v).key()) {
+        parent[v] = u;
+        pq.update(v, nd);
+      }
+    };
+
+    for (int s : order) {
+      if (state[s] != 0) continue;
+      if (normals[s].z() < 0) normals[s] = -normals[s];
+      state[s] = 2;
+      for (int j = 0; j < kk; ++j) relax(s, neighbors_[(size_t) s * kk + j]);
+      for (int e = in_off[s]; e < in_off[s + 1]; ++e) relax(s, in_idx[e]);
+
+      while (!pq.empty()) {
+        int u = pq.top().id();
+        pq.pop();
+        state[u] = 2;
+        if (normals[u].dot(normals[parent[u]]) < 0) normals[u] = -normals[u];
+        for (int j = 0; j < kk; ++j) relax(u, neighbors_[(size_t) u * kk + j]);
+        for (int e = in_off[u]; e < in_off[u + 1]; ++e) relax(u, in_idx[e]);
+      }
+    }
+  };
+
+  int k_;
+  bool isOrient_;
+  std::vector<int> neighbors_;     // 点 i の K近傍点は neighbors_[i * k ... ]
+  std::vector<Scalar> curvatures_;
+};
+
+//
+// MeshL の頂点の法線を求め，頂点の順の NormalL として持たせる
+// (これまでの NormalL は削除する．面があればハーフエッジにも頂点の法線を設定する)
+//
+inline void estimateNormals(MeshL& mesh, int k = 16, ThreadPool& pool = ThreadPool::instance()) {
+  KdTree<3, double> kdtree;
+  std::vector<VertexL*> vertices;
+  constructKdTree(kdtree, mesh, &vertices, pool);
+
+  NormalEstimator<double> estimator(k);
+  std::vector<Eigen::Vector3d> normals;
+  estimator.estimate(kdtree, normals, pool);
+
+  mesh.deleteAllNormals();
+  std::unordered_map<VertexL*, NormalL*> vn;
+  for (int i = 0; i < (int) vertices.size(); ++i) {
+    NormalL* nm = mesh.addNormal(normals[i]);
+    if (!mesh.faces().empty()) vn[vertices[i]] = nm;
+  }
+  for (auto fc : mesh.faces())
+    for (auto he : fc->halfedges()) he->setNormal(vn[he->vertex()]);
+}
+
+//
+// MeshR の点の法線を求めて normals() に書き込む
+//
+inline void estimateNormals(MeshR& mesh, int k = 16, ThreadPool& pool = ThreadPool::instance()) {
+  KdTree<3, float> kdtree;
+  constructKdTree(kdtree, mesh, pool);
+
+  NormalEstimator<float> estimator(k);
+  std::vector<Eigen::Vector3f> normals;
+  estimator.estimate(kdtree, normals, pool);
+
+  mesh.reserveNormals((int) normals.size());
+  parallelForRange(pool, 0, (int) normals.size(), 4096, [&mesh, &normals](int b, int e) {
+      for (int i = b; i < e; ++i) mesh.setNormal(3 * i, normals[i]); });
+}
+
+#endif // __NORMALESTIMATOR_HXX__
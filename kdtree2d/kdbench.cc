@@ -0,0 +1,442 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: kdbench.cc 2026/10/18 18:02:37 kanai Exp $
+//
+// kD-Tree のベンチマーク (表示なし)
+// - 点の数 (1e3 ... 最大 10 倍ずつ)・次元 (2, 3, 8)・点の分布ごとに，構築の時間と
+//   nn / knn / radius 探索の 1 秒あたりのクエリ数，辿ったノードの数を総当たりと比べる
+// - 総当たりの結果と一致しないクエリの数を err に出す
+// - 点の分布: uniform (単位立方体内の一様分布)，gaussian (64 個の中心のまわりの正規分布)，
+//   obj ファイルを渡すとその面上の一様分布 (3次元のみ)
+//
+// usage: kdbench [-n 最大の点の数 (既定 10000000)] [-q クエリの数 (既定 10000)]
+//                [-k 近傍点の数 (既定 8)] [-d 次元 (既定 2,3,8)] [-t スレッド数]
+//                [obj ファイル ...]
+//        kdbench -scaling [点の数 (既定 4000000)] [最大スレッド数 (既定 ハードウェアのスレッド数)]
+//        (-scaling は 3次元の点での並列構築のスケーリング)
+//
+// Copyright (c) 2026 by Takashi Kanai. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+using namespace std;
+
+#include "KdTree.hxx"
+#include "MeshL.hxx"
+#include "SMFLIO.hxx"
+
+static double elapsed( std::chrono::steady_clock::time_point t0 ) {
+  return std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+}
+
+//
+// 点の分布
+// operator()( gen ) で 1 点を返す
+//
+
+// 単位立方体内の一様分布
+template <int N>
+class UniformSampler {
+
+public:
+
+  typedef Eigen::Matrix<double,N,1> Point;
+
+  Point operator()( std::mt19937& gen ) {
+    Point p;
+    for ( int d = 0; d < N; ++d ) p[d] = uni_( gen );
+    return p;
+  };
+
+private:
+
+  std::uniform_real_distribution<double> uni_;
+};
+
+// 64 個の中心のまわりの正規分布 (中心ごとに広がりが異なる)
+template <int N>
+class GaussianSampler {
+
+public:
+
+  typedef Eigen::Matrix<double,N,1> Point;
+
+  enum { N_CLUSTERS = 64 };
+
+  GaussianSampler() : centers_( N_CLUSTERS ), sigmas_( N_CLUSTERS ) {
+    std::mt19937 gen( 0 );
+    for ( int i = 0; i < N_CLUSTERS; ++i ) {
+      for ( int d = 0; d < N; ++d ) centers_[i][d] = uni_( gen );
+      sigmas_[i] = 0.001 + 0.05 * uni_( gen ) * uni_( gen );
+    }
+  };
+
+  Point operator()( std::mt19937& gen ) {
+    int i = (int) ( uni_( gen ) * N_CLUSTERS ) % N_CLUSTERS;
+    Point p = centers_[i];
+    for ( int d = 0; d < N; ++d ) p[d] += sigmas_[i] * nrm_( gen );
+    return p;
+  };
+
+private:
+
+  std::vector<Point> centers_;
+  std::vector<double> sigmas_;
+  std::uniform_real_distribution<double> uni_;
+  std::normal_distribution<double> nrm_;
+};
+
+// メッシュの面上の一様分布 (多角形は扇状に三角形に分ける)
+class SurfaceSampler {
+
+public:
+
+  typedef Eigen::Vector3d Point;
+
+  bool load( const char* filename ) {
+    MeshL mesh;
+    SMFLIO smflio;
+    smflio.setMesh( mesh );
+    if ( !smflio.inputFromFile( filename ) ) return false;
+
+    tris_.clear(); areas_.clear();
+    double sum = .0;
+    for ( auto fc : mesh.faces() ) {
+      std::vector<Point> vp;
+      for ( auto he : fc->halfedges() ) vp.push_back( he->vertex()->point() );
+      for ( int i = 1; i + 1 < (int) vp.size(); ++i ) {
+        tris_.push_back( vp[0] ); tris_.push_back( vp[i] ); tris_.push_back( vp[i+1] );
+        sum += .5 * ( vp[i] - vp[0] ).cross( vp[i+1] - vp[0] ).norm();
+        areas_.push_back( sum );
+      }
+    }
+    return !areas_.empty() && ( sum > .0 );
+  };
+
+  Point operator()( std::mt19937& gen ) {
+    double a = uni_( gen ) * areas_.back();
+    int t = (int) ( std::upper_bound( areas_.begin(), areas_.end(), a ) - areas_.begin() );
+    t = std::min( t, (int) areas_.size() - 1 );
+    double r1 = std::sqrt( uni_( gen ) ), r2 = uni_( gen );
+    return ( 1.0 - r1 ) * tris_[3*t] + r1 * ( 1.0 - r2 ) * tris_[3*t+1] + r1 * r2 * tris_[3*t+2];
+  };
+
+private:
+
+  std::vector<Point> tris_;    // 三角形の頂点 (3 つずつ)
+  std::vector<double> areas_;  // 面積の累積和
+  std::uniform_real_distribution<double> uni_;
+};
+
+//
+// ベンチマークの設定
+//
+class Options {
+
+public:
+
+  Options() : max_n( 10000000 ), n_queries( 10000 ), k( 8 ),
+              n_threads( (int) std::thread::hardware_concurrency() ) {
+    dims.push_back( 2 ); dims.push_back( 3 ); dims.push_back( 8 );
+    if ( n_threads < 1 ) n_threads = 1;
+  };
+
+  int max_n;
+  int n_queries;
+  int k;
+  int n_threads;
+  std::vector<int> dims;
+  std::vector<std::string> meshes;
+};
+
+//
+// 総当たりの探索
+// 距離の2乗は kD-Tree の葉と同じく軸の順に足す (半径探索の境界の点も一致させるため)
+//
+template <int N>
+static double distance2( const Eigen::Matrix<double,N,1>& p, const Eigen::Matrix<double,N,1>& q ) {
+  double d2 = .0;
+  for ( int d = 0; d < N; ++d ) d2 += ( p[d] - q[d] ) * ( p[d] - q[d] );
+  return d2;
+}
+
+template <int N>
+static int bruteNN( const std::vector<Eigen::Matrix<double,N,1> >& points,
+                    const Eigen::Matrix<double,N,1>& q, double& min_d2 ) {
+  int index = -1;
+  min_d2 = std::numeric_limits<double>::max();
+  for ( int i = 0; i < (int) points.size(); ++i ) {
+    double d2 = distance2<N>( points[i], q );
+    if ( d2 < min_d2 ) { min_d2 = d2; index = i; }
+  }
+  return index;
+}
+
+// 距離の比較 (葉の距離は float でなく double なので誤差はほぼない)
+static bool sameDistance( double a, double b ) {
+  return ( a == b ) || ( std::fabs( a - b ) <= 1.0e-12 * std::max( a, b ) );
+}
+
+//
+// 1 つの点の分布・次元・点の数でのベンチマーク
+// - nn / knn / radius は 1 スレッドでクエリを順に処理する (総当たりと同じ条件)
+// - bbf-nodes, bbf-dists はクエリあたりの辿ったノードと距離を計算した点の数
+//   時間を計る深さ優先の探索は統計を取らないので，別に厳密な best-bin-first 探索
+//   (KdSearchParams の eps = 0) を行ったときの KdSearchStats の平均を出す
+// - radius の半径はクエリの k 番目の近傍点までの距離の中央値 (found は見つかった点の数の平均)
+// - batch は knnSearchBatch のスレッドプールでの並列処理
+// - 総当たりは時間がかかるので，点の数に応じてクエリを減らす
+//
+template <int N, class Sampler>
+static void bench( const char* name, Sampler& sampler, int n, const Options& opt, ThreadPool& pool ) {
+  typedef Eigen::Matrix<double,N,1> Point;
+
+  std::mt19937 gen( 1 );
+  std::vector<Point> points( n ), queries( opt.n_queries );
+  for ( auto& p : points ) p = sampler( gen );
+  for ( auto& q : queries ) q = sampler( gen );
+  int n_q = (int) queries.size(), k = std::min( opt.k, n );
+
+  // 構築
+  KdTree<N> kdtree;
+  auto t0 = std::chrono::steady_clock::now();
+  kdtree.construct( points.data(), n, pool );
+  double t_build = elapsed( t0 );
+
+  // 最近傍点
+  long long sum = 0;
+  t0 = std::chrono::steady_clock::now();
+  for ( auto& q : queries ) sum += kdtree.nnSearch( q );
+  double t_nn = elapsed( t0 );
+
+  // K近傍点
+  t0 = std::chrono::steady_clock::now();
+  for ( auto& q : queries ) sum += kdtree.knnSearch( q, k ).back();
+  double t_knn = elapsed( t0 );
+
+  // 辿ったノードの数 (時間を計った探索ではなく best-bin-first 探索の統計)
+  double nn_nodes = .0, nn_dists = .0, knn_nodes = .0;
+  for ( auto& q : queries ) {
+    KdSearchStats st;
+    double d;
+    kdtree.nnSearch( q, KdSearchParams(), &d, &st );
+    nn_nodes += st.nodes; nn_dists += st.points;
+    kdtree.knnSearch( q, k, KdSearchParams(), &st );
+    knn_nodes += st.nodes;
+  }
+
+  // 半径探索
+  std::vector<double> kth;
+  for ( int i = 0; i < std::min( n_q, 101 ); ++i ) {
+    std::vector<int> nb = kdtree.knnSearch( queries[i], k );
+    kth.push_back( std::sqrt( distance2<N>( points[nb.back()], queries[i] ) ) );
+  }
+  std::nth_element( kth.begin(), kth.begin() + kth.size() / 2, kth.end() );
+  double r = kth[kth.size() / 2];
+
+  long long found = 0;
+  t0 = std::chrono::steady_clock::now();
+  for ( auto& q : queries )
+    kdtree.radiusSearch( q, r, [&found]( int, double ) { ++found; return true; } );
+  double t_rad = elapsed( t0 );
+
+  // K近傍点の一括探索
+  std::vector<int> offsets, indices;
+  t0 = std::chrono::steady_clock::now();
+  kdtree.knnSearchBatch( queries, k, offsets, indices, nullptr, pool );
+  double t_batch = elapsed( t0 );
+
+  // 総当たり
+  int n_bf = std::max( 10, std::min( n_q, (int) ( 2.0e8 / ( (double) n * N ) ) ) );
+  t0 = std::chrono::steady_clock::now();
+  for ( int i = 0; i < n_bf; ++i ) {
+    double d2;
+    sum += bruteNN<N>( points, queries[i], d2 );
+  }
+  double t_bf = elapsed( t0 );
+
+  // 総当たりとの比較 (nn の距離，knn の距離の列，radius の点の数)
+  int n_err = 0;
+  std::vector<double> d2s( n );
+  for ( int i = 0; i < n_bf; ++i ) {
+    const Point& q = queries[i];
+    for ( int j = 0; j < n; ++j ) d2s[j] = distance2<N>( points[j], q );
+    bool ok = true;
+
+    double d;
+    kdtree.nnSearch( q, &d );
+    double min_d2 = *std::min_element( d2s.begin(), d2s.end() );
+    if ( !sameDistance( d * d, min_d2 ) ) ok = false;
+
+    std::vector<int> nb = kdtree.knnSearch( q, k );
+    std::partial_sort( d2s.begin(), d2s.begin() + k, d2s.end() );
+    if ( (int) nb.size() != k ) ok = false;
+    for ( int j = 0; ok && ( j < k ); ++j )
+      if ( !sameDistance( distance2<N>( points[nb[j]], q ), d2s[j] ) ) ok = false;
+
+    int cnt = 0, cnt_bf = 0;
+    kdtree.radiusSearch( q, r, [&cnt]( int, double ) { ++cnt; return true; } );
+    for ( auto& p : points ) if ( distance2<N>( p, q ) <= r * r ) ++cnt_bf;
+    if ( cnt != cnt_bf ) ok = false;
+
+    if ( !ok ) ++n_err;
+  }
+
+  double qps_nn = n_q / t_nn, qps_bf = n_bf / t_bf;
+  printf( "%-12s %3d %9d %8.3f %10.0f %10.0f %8.1f %9.1f %9.1f %10.0f %9.1f %10.0f %7.1f %10.0f %4d/%d\n",
+          name, N, n, t_build, qps_nn, qps_bf, qps_nn / qps_bf,
+          nn_nodes / n_q, nn_dists / n_q, n_q / t_knn, knn_nodes / n_q,
+          n_q / t_rad, (double) found / n_q, n_q / t_batch, n_err, n_bf );
+  fflush( stdout );
+  if ( sum == 0x7fffffffffffffffLL ) std::cout << std::endl; // 探索が最適化で消されないように
+}
+
+template <int N, class Sampler>
+static void benchSizes( const char* name, Sampler& sampler, const Options& opt, ThreadPool& pool ) {
+  for ( long long n = 1000; n <= opt.max_n; n *= 10 ) bench<N>( name, sampler, (int) n, opt, pool );
+}
+
+template <int N>
+static void benchDim( const Options& opt, ThreadPool& pool ) {
+  UniformSampler<N> uniform;
+  benchSizes<N>( "uniform", uniform, opt, pool );
+  GaussianSampler<N> gaussian;
+  benchSizes<N>( "gaussian", gaussian, opt, pool );
+}
+
+//
+// 並列構築のスケーリング (3次元の一様分布・正規分布)
+//
+
+// 最近傍点が総当たりと一致するか (数点だけ)
+static int check( KdTree<3>& kdtree, const std::vector<Eigen::Vector3d>& points ) {
+  std::mt19937 gen( 2 );
+  std::uniform_real_distribution<double> uni( 0.0, 1.0 );
+  int n_diff = 0;
+  for ( int k = 0; k < 10; ++k ) {
+    Eigen::Vector3d q( uni( gen ), uni( gen ), uni( gen ) );
+    double best;
+    bruteNN<3>( points, q, best );
+    double d;
+    kdtree.nnSearch( q, &d );
+    if ( !sameDistance( d * d, best ) ) ++n_diff;
+  }
+  return n_diff;
+}
+
+template <class Sampler>
+static void scalingDist( const char* dist, Sampler& sampler, int n, const std::vector<int>& threads ) {
+  std::mt19937 gen( 1 );
+  std::vector<Eigen::Vector3d> points( n );
+  for ( auto& p : points ) p = sampler( gen );
+
+  double t1 = .0;
+  for ( auto t : threads ) {
+    ThreadPool pool( t );
+    KdTree<3> kdtree;
+
+    // ポインタと個数で渡す (コピーなし)
+    auto t0 = std::chrono::steady_clock::now();
+    kdtree.construct( points.data(), n, pool );
+    double t_build = elapsed( t0 );
+    if ( t == 1 ) t1 = t_build;
+    int n_diff = check( kdtree, points );
+
+    // vector のコピーとムーブ
+    t0 = std::chrono::steady_clock::now();
+    kdtree.construct( points, pool );
+    double t_copy = elapsed( t0 );
+
+    std::vector<Eigen::Vector3d> moved( points );
+    t0 = std::chrono::steady_clock::now();
+    kdtree.construct( std::move( moved ), pool );
+    double t_move = elapsed( t0 );
+
+    printf( "%-10s %8d %10.4f %8.2f %10.4f %10.4f\n", dist, t, t_build, t1 / t_build, t_copy, t_move );
+    if ( n_diff ) std::cout << "  mismatches: " << n_diff << std::endl;
+  }
+}
+
+static void scaling( int n, int hw ) {
+  std::vector<int> threads;
+  if ( hw < 1 ) hw = 1;
+  for ( int t = 1; t < hw; t *= 2 ) threads.push_back( t );
+  threads.push_back( hw );
+
+  std::cout << "points: " << n << "  max threads: " << hw << std::endl;
+  printf( "%-10s %8s %10s %8s %10s %10s\n", "dist", "threads", "build", "speedup", "copy", "move" );
+
+  UniformSampler<3> uniform;
+  scalingDist( "uniform", uniform, n, threads );
+  GaussianSampler<3> gaussian;
+  scalingDist( "gaussian", gaussian, n, threads );
+}
+
+int main( int argc, char* argv[] ) {
+  if ( ( argc > 1 ) && !strcmp( argv[1], "-scaling" ) ) {
+    scaling( ( argc > 2 ) ? atoi( argv[2] ) : 4000000,
+             ( argc > 3 ) ? atoi( argv[3] ) : (int) std::thread::hardware_concurrency() );
+    return EXIT_SUCCESS;
+  }
+
+  Options opt;
+  for ( int i = 1; i < argc; ++i ) {
+    std::string a( argv[i] );
+    if ( ( a == "-n" ) && ( i + 1 < argc ) ) opt.max_n = atoi( argv[++i] );
+    else if ( ( a == "-q" ) && ( i + 1 < argc ) ) opt.n_queries = std::max( 1, atoi( argv[++i] ) );
+    else if ( ( a == "-k" ) && ( i + 1 < argc ) ) opt.k = std::max( 1, atoi( argv[++i] ) );
+    else if ( ( a == "-t" ) && ( i + 1 < argc ) ) opt.n_threads = std::max( 1, atoi( argv[++i] ) );
+    else if ( ( a == "-d" ) && ( i + 1 < argc ) ) {
+      opt.dims.clear();
+      std::istringstream is( argv[++i] );
+      std::string s;
+      while ( std::getline( is, s, ',' ) ) opt.dims.push_back( atoi( s.c_str() ) );
+    }
+    else if ( a[0] == '-' ) {
+      std::cerr << "unknown option: " << a << std::endl;
+      return EXIT_FAILURE;
+    }
+    else opt.meshes.push_back( a );
+  }
+
+  ThreadPool pool( opt.n_threads );
+  std::cout << "max points: " << opt.max_n << "  queries: " << opt.n_queries
+            << "  k: " << opt.k << "  threads: " << opt.n_threads << std::endl;
+  printf( "%-12s %3s %9s %8s %10s %10s %8s %9s %9s %10s %9s %10s %7s %10s %s\n",
+          "dist", "dim", "points", "build", "nn[q/s]", "brute[q/s]", "speedup", "bbf-nodes", "bbf-dists",
+          "knn[q/s]", "bbf-nodes", "rad[q/s]", "found", "batch[q/s]", "err" );
+
+  for ( auto dim : opt.dims ) {
+    switch ( dim ) {
+    case 2: benchDim<2>( opt, pool ); break;
+    case 3: benchDim<3>( opt, pool ); break;
+    case 8: benchDim<8>( opt, pool ); break;
+    default: std::cerr << "unsupported dimension: " << dim << std::endl; break;
+    }
+
+    if ( dim != 3 ) continue;
+    for ( auto& file : opt.meshes ) {
+      SurfaceSampler surface;
+      if ( !surface.load( file.c_str() ) ) {
+        std::cerr << "cannot sample " << file << std::endl;
+        continue;
+      }
+      std::string name( file.substr( file.find_last_of( "/\\" ) + 1 ) );
+      benchSizes<3>( name.c_str(), surface, opt, pool );
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
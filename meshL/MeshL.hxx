@@ -14,6 +14,9 @@
 
 #include <list>
 #include <vector>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
 using namespace std;
 
 #include "myEigen.hxx"
@@ -433,6 +436,124 @@ class MeshL {
     if (isRecalculateBLoop) createBLoop(bloop()->vertex(0));
   };
 
+  //
+  // 頂点の溶接: 距離 tol 以内の頂点を 1 つにまとめる (tol = 0 なら座標が一致する頂点)
+  // - 一辺 tol のセルのハッシュ格子に代表の頂点を登録し，近傍 27 セルの代表から tol 以内の
+  //   ものを探す．頂点の順に調べ，最初に見つかった代表にまとめる (期待値 O(n))
+  // - ハーフエッジと境界ループの頂点を代表に付け替えて使われなくなった頂点を削除し，
+  //   頂点が 3 つ未満に縮退した面を削除する
+  // - 頂点・面の id を 0 から振り直す．接続情報があれば削除するので，後で createConnectivity() を呼ぶ
+  // - 削除した頂点の数を返す
+  //
+  int weldVertices(double tol = .0) {
+    if (isConnectivity()) {
+      if (!(edges_.empty())) deleteAllEdges();
+      deleteConnectivity();
+    }
+
+    // セルのキー (tol = 0 なら座標のビット列そのもの)
+    struct CellKey {
+      long long x, y, z;
+      bool operator==(const CellKey& k) const { return (x == k.x) && (y == k.y) && (z == k.z); };
+    };
+    struct CellHash {
+      size_t operator()(const CellKey& k) const {
+        return (size_t) ((unsigned long long) k.x * 73856093ULL ^ (unsigned long long) k.y * 19349663ULL ^
+                         (unsigned long long) k.z * 83492791ULL);
+      };
+    };
+    auto cell = [tol](const Eigen::Vector3d& p) {
+      CellKey k;
+      if (tol > .0) {
+        k.x = (long long) std::floor(p.x() / tol);
+        k.y = (long long) std::floor(p.y() / tol);
+        k.z = (long long) std::floor(p.z() / tol);
+      } else {
+        double c[3] = { p.x() + .0, p.y() + .0, p.z() + .0 }; // -0 を +0 にそろえる
+        std::memcpy(&k, c, sizeof(c));
+      }
+      return k;
+    };
+
+    // 代表の頂点をセルごとの連結リスト (head: セル -> 先頭, next: 次の代表) に登録する
+    std::vector<VertexL*> vts(vertices_.begin(), vertices_.end());
+    int n = (int) vts.size();
+    for (int i = 0; i < n; ++i) vts[i]->setID(i);
+    std::vector<int> rep(n), next(n, -1);
+    std::unordered_map<CellKey, int, CellHash> head;
+    head.reserve(n);
+    double tol2 = tol * tol;
+    for (int i = 0; i < n; ++i) {
+      const Eigen::Vector3d& p = vts[i]->point();
+      CellKey c = cell(p);
+      rep[i] = i;
+      if (tol > .0) {
+        for (int dz = -1; (dz <= 1) && (rep[i] == i); ++dz)
+          for (int dy = -1; (dy <= 1) && (rep[i] == i); ++dy)
+            for (int dx = -1; (dx <= 1) && (rep[i] == i); ++dx) {
+              CellKey k = { c.x + dx, c.y + dy, c.z + dz };
+              auto it = head.find(k);
+              if (it == head.end()) continue;
+              for (int j = it->second; j >= 0; j = next[j])
+                if ((vts[j]->point() - p).squaredNorm() <= tol2) { rep[i] = j; break; }
+            }
+      } else {
+        auto it = head.find(c);
+        if (it != head.end()) rep[i] = it->second;
+      }
+      if (rep[i] != i) continue;
+
+      auto it = head.find(c);
+      if (it != head.end()) { next[i] = it->second; it->second = i; }
+      else head[c] = i;
+    }
+
+    // 付け替え
+    for (auto fc : faces_)
+      for (auto he : fc->halfedges()) he->setVertex(vts[rep[he->vertex()->id()]]);
+    for (auto bl : bloops_)
+      for (auto& vt : bl->vertices()) vt = vts[rep[vt->id()]];
+
+    int n_deleted = 0;
+    for (int i = 0; i < n; ++i)
+      if (rep[i] != i) { deleteVertex(vts[i]); ++n_deleted; }
+
+    deleteDegenerateFaces();
+
+    resetVertexID();
+    v_id_ = n_vt_;
+    resetFaceID();
+    f_id_ = (int) faces_.size();
+
+    return n_deleted;
+  };
+
+  //
+  // 縮退した面の削除: 連続する同じ頂点のハーフエッジを除き，頂点が 3 つ未満になった面を削除する
+  // 削除した面の数を返す
+  //
+  int deleteDegenerateFaces() {
+    std::vector<FaceL*> degenerate;
+    for (auto fc : faces_) {
+      std::list<HalfedgeL*>& hes = fc->halfedges();
+      for (auto it = hes.begin(); (it != hes.end()) && (hes.size() > 1);) {
+        auto nx = std::next(it);
+        if (nx == hes.end()) nx = hes.begin();
+        if ((*it)->vertex() == (*nx)->vertex()) {
+          delete *nx;
+          if (nx == hes.begin()) { hes.erase(nx); break; }
+          hes.erase(nx);
+        } else {
+          ++it;
+        }
+      }
+      if (fc->size() < 3) degenerate.push_back(fc);
+      else fc->calcNormal();
+    }
+    for (auto fc : degenerate) deleteFace(fc);
+    return (int) degenerate.size();
+  };
+
   bool isConnectivity() const { return isConnectivity_; };
   void setConnectivity(bool f) { isConnectivity_ = f; };
 
@@ -18,76 +18,82 @@ using namespace std;
 
 #include "LIO.hxx"
 #include "myEigen.hxx"
-#include "strutil.h"
-#include "tokenizer.h"
+#include "OBJScanner.hxx"
 
 class SMFLIO : public LIO {
  public:
-  SMFLIO() : LIO(), isSaveNormalization_(false){};
-  SMFLIO(MeshL& mesh) : LIO(mesh), isSaveNormalization_(false){};
+  SMFLIO() : LIO(), isSaveNormalization_(false), isWeld_(false), weld_tol_(.0){};
+  SMFLIO(MeshL& mesh) : LIO(mesh), isSaveNormalization_(false), isWeld_(false), weld_tol_(.0){};
   ~SMFLIO(){};
 
   void setSaveNormalization(bool f) { isSaveNormalization_ = f; };
   bool isSaveNormalization() const { return isSaveNormalization_; };
 
+  // 読み込み後に距離 tol 以内の頂点を溶接する (MeshL::weldVertices)
+  void setWeld(bool f, double tol = .0) { isWeld_ = f; weld_tol_ = tol; };
+  bool isWeld() const { return isWeld_; };
+
+  //
+  // OBJ (SMF) ファイルの読み込み
+  // - ファイルをメモリにマップして 1 回で読む (OBJScanner)
+  // - 先に頂点・法線・テクスチャ座標の数を数えて番号から引く配列を確保しておく
+  //
   bool inputFromFile(const char* const filename) {
     //
     // file open
     //
-    std::ifstream ifs;
-    ifs.open(filename);
-    if (!ifs.is_open()) {
+    OBJScanner scanner;
+    if (!scanner.open(filename)) {
       std::cerr << "Cannot open " << filename << std::endl;
       return false;
     }
 
+    // count elements
+    int v_count = 0;
+    int n_count = 0;
+    int t_count = 0;
+    scanner.forEachLine([&](OBJLine& line) {
+      std::string_view fw = line.word();
+      if (fw == "v")
+        ++v_count;
+      else if (fw == "n")
+        ++n_count;
+      else if ((fw == "r") || (fw == "vt"))
+        ++t_count;
+    });
+
     // for refering vertex pointer
     std::vector<VertexL*> vertex_p;
     std::vector<NormalL*> normal_p;
     std::vector<TexcoordL*> tcoord_p;
-    int v_count = 0;
-    int f_count = 0;
+    vertex_p.reserve(v_count);
+    normal_p.reserve(n_count);
+    tcoord_p.reserve(t_count);
+
     //
     // parse smf
     //
-    std::string cline;
-    StrUtil strutil;
-    while (getline(ifs, cline, '\n')) {
-      std::string fw;
-      strutil.first_word(cline, fw);
-
-      // comment
-      if (mycomment(cline[0])) continue;
+    scanner.forEachLine([&](OBJLine& line) {
+      std::string_view fw = line.word();
 
       // read vertices
-      else if (!fw.compare("v")) {
-        std::istringstream isstr(cline);
-
-        // "v"
-        std::string str;
-        isstr >> str;
-        double x, y, z;
-        isstr >> x;
-        isstr >> y;
-        isstr >> z;
+      if (fw == "v") {
+        double x = .0, y = .0, z = .0;
+        line.number(x);
+        line.number(y);
+        line.number(z);
         Eigen::Vector3d p(x, y, z);
 
         VertexL* vt = mesh().addVertex(p);
         vertex_p.push_back(vt);
-        ++v_count;
       }
 
       // read normals
-      else if (!fw.compare("n")) {
-        std::istringstream isstr(cline);
-
-        // "n"
-        std::string str;
-        isstr >> str;
-        double x, y, z;
-        isstr >> x;
-        isstr >> y;
-        isstr >> z;
+      else if (fw == "n") {
+        double x = .0, y = .0, z = .0;
+        line.number(x);
+        line.number(y);
+        line.number(z);
         Eigen::Vector3d p(x, y, z);
 
         NormalL* nm = mesh().addNormal(p);
@@ -95,19 +101,11 @@ class SMFLIO : public LIO {
       }
 
       // read texture coordinates
-      else if (!fw.compare("r") || !fw.compare("vt")) {
-        std::istringstream isstr(cline);
-
-        // "r"
-        std::string str;
-        isstr >> str;
-        double x, y, z;
-        isstr >> x;
-        isstr >> y;
-        if (isstr)
-          isstr >> z;
-        else
-          z = .0;
+      else if ((fw == "r") || (fw == "vt")) {
+        double x = .0, y = .0, z = .0;
+        line.number(x);
+        line.number(y);
+        line.number(z);
         Eigen::Vector3d p(x, y, z);
 
         TexcoordL* tc = mesh().addTexcoord(p);
@@ -115,57 +113,33 @@ class SMFLIO : public LIO {
       }
 
       // read faces
-      else if (!fw.compare("f")) {
-        std::istringstream isstr(cline);
-
-        // "f"
-        std::string str;
-        isstr >> str;
+      // 角は "頂点/法線/テクスチャ座標" (法線・テクスチャ座標はあれば)
+      else if (fw == "f") {
+        bool hasNormal = !(mesh().normals().empty());
+        bool hasTexcoord = !(mesh().texcoords().empty());
 
         FaceL* fc = mesh().addFace();
-        while (isstr >> str) {
-          tokenizer tok(str, "/");
-
+        int ids[3];
+        int n;
+        while ((n = line.corner(ids)) > 0) {
           // vertex
-          std::string val = tok.next();
-
-          int id;
-          std::istringstream ai(val);
-          ai >> id;
-          HalfedgeL* he = mesh().addHalfedge(fc, vertex_p[id - 1], NULL);
+          HalfedgeL* he = mesh().addHalfedge(fc, vertex_p[ids[0] - 1], NULL);
 
           // normal
-          if (!(mesh().normals().empty())) {
-            val = tok.next();
-            std::istringstream ai(val);
-            ai >> id;
-            he->setNormal(normal_p[id - 1]);
-          }
+          int j = 1;
+          if (hasNormal && (j < n)) he->setNormal(normal_p[ids[j++] - 1]);
           // texcoord
-          if (!(mesh().texcoords().empty())) {
-            val = tok.next();
-            std::istringstream ai(val);
-            ai >> id;
-            he->setTexcoord(tcoord_p[id - 1]);
-          }
+          if (hasTexcoord && (j < n)) he->setTexcoord(tcoord_p[ids[j] - 1]);
         }
 
         fc->calcNormal();
-
-        ++f_count;
       }
 
       // read boundary loop
-      else if (!fw.compare("b")) {
-        std::istringstream isstr(cline);
-
-        // "b"
-        std::string str;
-        isstr >> str;
-
+      else if (fw == "b") {
         BLoopL* bl = mesh().addBLoop();
         int id;
-        while (isstr >> id) {
+        while (line.number(id)) {
           if (id > 0) {
             bl->addIsCorner(true);
           } else {
@@ -177,10 +151,14 @@ class SMFLIO : public LIO {
         std::cout << "b: " << bl->vertices().size() << " vertices."
                   << std::endl;
       }
+    });
 
-    }  // while
+    scanner.close();
 
-    ifs.close();
+    if (isWeld()) {
+      int n = mesh().weldVertices(weld_tol_);
+      std::cout << "weld: " << n << " vertices merged." << std::endl;
+    }
 
     mesh().printInfo();
 
@@ -323,5 +301,7 @@ class SMFLIO : public LIO {
 
  private:
   bool isSaveNormalization_;
+  bool isWeld_;
+  double weld_tol_;
 };
 #endif  // _SMFLIO_H
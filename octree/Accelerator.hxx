@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: Accelerator.hxx 2026/10/18 14:05:12 kanai Exp $
+//
+// Copyright (c) 2026 by Takashi Kanai. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef _ACCELERATOR_HXX
+#define _ACCELERATOR_HXX 1
+
+#include <vector>
+#include <limits>
+using namespace std;
+
+#include "myEigen.hxx"
+#include "RayHit.hxx"
+#include "ThreadPool.hxx"
+
+//
+// メッシュの面に対する問い合わせ (レイ，シャドウレイ，最近点) の共通インタフェース
+// - Octree と BVH がこれを継承し，アプリケーションはどちらでも同じように使える
+// - バッチ版の既定の実装は 1 本ずつの問い合わせを ThreadPool で並列に呼ぶ
+//
+class Accelerator {
+
+public:
+
+  virtual ~Accelerator() {};
+
+  // 名前 (ベンチマークの表示用)
+  virtual const char* name() const = 0;
+
+  // レイ origin + t * dir (0 <= t <= tmax) とメッシュとの最近交点
+  virtual RayHit raycast( const Eigen::Vector3d& origin, const Eigen::Vector3d& dir,
+                          double tmax = std::numeric_limits<double>::max() ) = 0;
+
+  // [0, tmax] の範囲にひとつでも交点があれば true
+  virtual bool anyHit( const Eigen::Vector3d& origin, const Eigen::Vector3d& dir,
+                       double tmax = std::numeric_limits<double>::max() ) = 0;
+
+  // 点 p に最も近いメッシュ上の点 (距離が max_dist 以上のものは探さない)
+  virtual ClosestHit closestPoint( const Eigen::Vector3d& p,
+                                   double max_dist = std::numeric_limits<double>::max() ) = 0;
+
+  // 複数のレイの最近交点 (hits[i] に格納)
+  virtual void raycastBatch( const std::vector<Eigen::Vector3d>& origins,
+                             const std::vector<Eigen::Vector3d>& dirs,
+                             std::vector<RayHit>& hits,
+                             double tmax = std::numeric_limits<double>::max(),
+                             ThreadPool& pool = ThreadPool::instance() ) {
+    int n = (int) std::min( origins.size(), dirs.size() );
+    hits.resize( n );
+    parallelFor( pool, 0, n, 256, [&]( int i ) { hits[i] = raycast( origins[i], dirs[i], tmax ); } );
+  };
+
+  // 複数のシャドウレイの判定 (遮られていれば occluded[i] = 1)
+  virtual void anyHitBatch( const std::vector<Eigen::Vector3d>& origins,
+                            const std::vector<Eigen::Vector3d>& dirs,
+                            std::vector<char>& occluded,
+                            double tmax = std::numeric_limits<double>::max(),
+                            ThreadPool& pool = ThreadPool::instance() ) {
+    int n = (int) std::min( origins.size(), dirs.size() );
+    occluded.resize( n );
+    parallelFor( pool, 0, n, 256, [&]( int i ) {
+        occluded[i] = anyHit( origins[i], dirs[i], tmax ) ? 1 : 0;
+      } );
+  };
+
+  // 複数の点の最近点 (hits[i] に格納)
+  virtual void closestPointBatch( const std::vector<Eigen::Vector3d>& points,
+                                  std::vector<ClosestHit>& hits,
+                                  double max_dist = std::numeric_limits<double>::max(),
+                                  ThreadPool& pool = ThreadPool::instance() ) {
+    int n = (int) points.size();
+    hits.resize( n );
+    parallelFor( pool, 0, n, 64, [&]( int i ) { hits[i] = closestPoint( points[i], max_dist ); } );
+  };
+};
+
+#endif // _ACCELERATOR_HXX
@@ -0,0 +1,511 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: BVH.hxx 2026/10/18 14:21:37 kanai Exp $
+//
+// Copyright (c) 2026 by Takashi Kanai. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef _BVH_HXX
+#define _BVH_HXX 1
+
+#include <vector>
+#include <list>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+using namespace std;
+
+#include "myEigen.hxx"
+#include "FaceL.hxx"
+#include "VMProc.hxx"
+
+#include "raytri.h"
+
+#include "OctreeTri.hxx"
+#include "RayHit.hxx"
+#include "ThreadPool.hxx"
+#include "Accelerator.hxx"
+
+//
+// BVH のノード (64 バイト)
+// - 内部ノード (count == 0): 子は nodes[start] と nodes[start + 1]
+// - 葉 (count > 0): 三角形 tris[start] から count 個
+//
+struct BVHNode {
+  double bbmin[3], bbmax[3];
+  int start;
+  int count;
+  int axis;     // 分割した軸
+  int pad;
+
+  bool isLeaf() const { return ( count > 0 ) ? true : false; };
+};
+
+//
+// 面の Bounding Volume Hierarchy
+// - Surface Area Heuristic (SAH) をビンで近似して分割する
+// - ノードは配列 nodes_ に並べ，三角形のレコードは葉ごとに連続するよう並べ替えて持つ
+// - 大きいノードのビンの集計と，子ノードの構築は ThreadPool で並列に行う
+// - Octree と違い各面はひとつの葉にだけ入るので，細長い三角形も重複しない
+//
+class BVH : public Accelerator {
+
+public:
+
+  BVH() : max_leaf_(8), n_bins_(16), n_nodes_(0) {};
+  ~BVH() {};
+
+  const char* name() const { return "BVH"; };
+
+  // 葉に入れる三角形の数の上限
+  void setMaxLeafSize( int n ) { max_leaf_ = std::max( n, 1 ); };
+  // SAH を評価するビンの数
+  void setNumBins( int n ) { n_bins_ = std::max( std::min( n, (int) MAX_BINS ), 2 ); };
+
+  int nodes_size() const { return (int) nodes_.size(); };
+  const BVHNode& node( int i ) const { return nodes_[i]; };
+  int tris_size() const { return (int) tris_.size(); };
+  const OctreeTri& tri( int i ) const { return tris_[i]; };
+  FaceL* face( int id ) const { return faces_[id]; };
+
+  //
+  // 面の集合から BVH を構築する
+  //
+  void build( const std::vector<FaceL*>& faces, ThreadPool& pool = ThreadPool::instance() ) {
+    faces_ = faces;
+    int n = (int) faces_.size();
+    nodes_.clear();
+    tris_.clear();
+    if ( n == 0 ) return;
+
+    // 三角形のレコードと AABB, 重心
+    std::vector<OctreeTri> tris( n );
+    prims_.resize( n );
+    parallelFor( pool, 0, n, 1024, [&]( int i ) {
+        tris[i].set( faces_[i], i );
+        Prim& pr = prims_[i];
+        for ( int j = 0; j < 3; ++j ) {
+          double a = tris[i].v0[j], b = a + tris[i].e1[j], c = a + tris[i].e2[j];
+          pr.lo[j] = std::min( a, std::min( b, c ) );
+          pr.hi[j] = std::max( a, std::max( b, c ) );
+          pr.c[j] = ( pr.lo[j] + pr.hi[j] ) * 0.5;
+        }
+      } );
+
+    idx_.resize( n );
+    for ( int i = 0; i < n; ++i ) idx_[i] = i;
+
+    // 葉がひとつずつの場合でもノードは 2n - 1 個以下
+    nodes_.resize( 2 * n );
+    n_nodes_ = 1;
+    buildNode( 0, 0, n, 0, pool );
+    nodes_.resize( n_nodes_.load() );
+
+    tris_.resize( n );
+    parallelFor( pool, 0, n, 4096, [&]( int k ) { tris_[k] = tris[ idx_[k] ]; } );
+
+    std::vector<Prim>().swap( prims_ );
+    std::vector<int>().swap( idx_ );
+  };
+
+  void build( std::list<FaceL*>& faces, ThreadPool& pool = ThreadPool::instance() ) {
+    std::vector<FaceL*> fv( faces.begin(), faces.end() );
+    build( fv, pool );
+  };
+
+  //
+  // レイ origin + t * dir (0 <= t <= tmax) とメッシュとの最近交点
+  // - 2 つの子のうちレイが先に入る方から辿り，もう一方はスタックに積む
+  // - スタックから取り出したノードの入口が見つかった交点より遠ければ飛ばす
+  //
+  RayHit raycast( const Eigen::Vector3d& origin, const Eigen::Vector3d& dir,
+                  double tmax = std::numeric_limits<double>::max() ) {
+    RayHit hit;
+    hit.t = tmax;
+    if ( nodes_.empty() ) return RayHit();
+
+    double orig[3] = { origin.x(), origin.y(), origin.z() };
+    double ddir[3] = { dir.x(), dir.y(), dir.z() };
+    double inv[3] = { 1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z() };
+
+    int stack[STACK_SIZE];
+    double stack_t[STACK_SIZE];
+    int sp = 0;
+
+    double t_near;
+    int ni = 0;
+    if ( !rayBox( nodes_[0], orig, inv, hit.t, t_near ) ) return RayHit();
+
+    while ( true ) {
+      const BVHNode& nd = nodes_[ni];
+      if ( nd.isLeaf() ) {
+        for ( int k = nd.start; k < nd.start + nd.count; ++k ) {
+          double t, u, v;
+          if ( intersect_triangle2_edge( orig, ddir, tris_[k].v0, tris_[k].e1, tris_[k].e2, &t, &u, &v )
+               && ( t >= .0 ) && ( t < hit.t ) ) {
+            hit.face = faces_[ tris_[k].id ];
+            hit.t = t;
+            hit.u = u;
+            hit.v = v;
+          }
+        }
+      } else {
+        int l = nd.start, r = nd.start + 1;
+        double tl, tr;
+        bool hl = rayBox( nodes_[l], orig, inv, hit.t, tl );
+        bool hr = rayBox( nodes_[r], orig, inv, hit.t, tr );
+        if ( hl && hr ) {
+          if ( tr < tl ) { std::swap( l, r ); std::swap( tl, tr ); }
+          stack[sp] = r;
+          stack_t[sp++] = tr;
+          ni = l;
+          continue;
+        }
+        if ( hl ) { ni = l; continue; }
+        if ( hr ) { ni = r; continue; }
+      }
+
+      // スタックから次のノードを取り出す
+      bool found = false;
+      while ( sp > 0 ) {
+        --sp;
+        if ( stack_t[sp] <= hit.t ) { ni = stack[sp]; found = true; break; }
+      }
+      if ( !found ) break;
+    }
+
+    if ( !hit.isHit() ) hit.t = std::numeric_limits<double>::max();
+    return hit;
+  };
+
+  //
+  // シャドウレイ用: [0, tmax] の範囲にひとつでも交点があれば true を返す
+  //
+  bool anyHit( const Eigen::Vector3d& origin, const Eigen::Vector3d& dir,
+               double tmax = std::numeric_limits<double>::max() ) {
+    if ( nodes_.empty() ) return false;
+
+    double orig[3] = { origin.x(), origin.y(), origin.z() };
+    double ddir[3] = { dir.x(), dir.y(), dir.z() };
+    double inv[3] = { 1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z() };
+
+    int stack[STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = 0;
+    while ( sp > 0 ) {
+      const BVHNode& nd = nodes_[ stack[--sp] ];
+      double t_near;
+      if ( !rayBox( nd, orig, inv, tmax, t_near ) ) continue;
+      if ( nd.isLeaf() ) {
+        for ( int k = nd.start; k < nd.start + nd.count; ++k ) {
+          double t, u, v;
+          if ( intersect_triangle2_edge( orig, ddir, tris_[k].v0, tris_[k].e1, tris_[k].e2, &t, &u, &v )
+               && ( t >= .0 ) && ( t <= tmax ) ) return true;
+        }
+      } else {
+        stack[sp++] = nd.start + 1;
+        stack[sp++] = nd.start;
+      }
+    }
+    return false;
+  };
+
+  //
+  // 点 p に最も近いメッシュ上の点を求める (距離が max_dist 以上のものは探さない)
+  // - 2 つの子のうちボックスが近い方から辿り，ボックスまでの距離が
+  //   現在の最近点より遠いノードは飛ばす
+  //
+  ClosestHit closestPoint( const Eigen::Vector3d& p,
+                           double max_dist = std::numeric_limits<double>::max() ) {
+    ClosestHit hit;
+    hit.distance = max_dist;
+    if ( nodes_.empty() ) return ClosestHit();
+
+    int stack[STACK_SIZE];
+    double stack_d[STACK_SIZE];
+    int sp = 0;
+    stack[sp] = 0;
+    stack_d[sp++] = boxDistance2( nodes_[0], p );
+
+    while ( sp > 0 ) {
+      --sp;
+      if ( stack_d[sp] >= hit.distance * hit.distance ) continue;
+      const BVHNode& nd = nodes_[ stack[sp] ];
+      if ( nd.isLeaf() ) {
+        for ( int k = nd.start; k < nd.start + nd.count; ++k ) {
+          const OctreeTri& tri = tris_[k];
+          Eigen::Vector3d q;
+          double bc[3];
+          double d = triClosestPoint( p, tri.point(0), tri.point(1), tri.point(2), q, bc );
+          if ( d < hit.distance ) {
+            hit.face = faces_[ tri.id ];
+            hit.point = q;
+            hit.distance = d;
+            hit.bc[0] = bc[0]; hit.bc[1] = bc[1]; hit.bc[2] = bc[2];
+          }
+        }
+        continue;
+      }
+
+      // 遠い方を先に積み，近い方を先に取り出す
+      int l = nd.start, r = nd.start + 1;
+      double dl = boxDistance2( nodes_[l], p ), dr = boxDistance2( nodes_[r], p );
+      if ( dl < dr ) { std::swap( l, r ); std::swap( dl, dr ); }
+      stack[sp] = l; stack_d[sp++] = dl;
+      stack[sp] = r; stack_d[sp++] = dr;
+    }
+
+    if ( !hit.isHit() ) hit.distance = std::numeric_limits<double>::max();
+    return hit;
+  };
+
+private:
+
+  //
+  // STACK_SIZE: 走査のスタックの大きさ
+  // MAX_SAH_DEPTH: これより深いノードは SAH でなく重心の中央値で分割する
+  // - 中央値の分割は三角形の数を半分にするので，木の深さは MAX_SAH_DEPTH + 31 以下になる
+  // - raycast() はレベルごとに 1 つ，anyHit() / closestPoint() は 2 つまで積むので，
+  //   スタックの深さは木の深さ + 1 以下で STACK_SIZE を超えない
+  //
+  enum { MAX_BINS = 32, STACK_SIZE = 128, MAX_SAH_DEPTH = 64 };
+
+  // 構築中の三角形の AABB と重心
+  struct Prim {
+    double lo[3], hi[3], c[3];
+  };
+
+  // SAH のビン
+  struct Bin {
+    double lo[3], hi[3];
+    int count;
+
+    Bin() : count(0) {
+      for ( int j = 0; j < 3; ++j ) {
+        lo[j] = std::numeric_limits<double>::max();
+        hi[j] = -std::numeric_limits<double>::max();
+      }
+    };
+    void add( const double blo[3], const double bhi[3], int n ) {
+      for ( int j = 0; j < 3; ++j ) {
+        lo[j] = std::min( lo[j], blo[j] );
+        hi[j] = std::max( hi[j], bhi[j] );
+      }
+      count += n;
+    };
+    // 表面積の半分
+    double area() const {
+      if ( count == 0 ) return .0;
+      double dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+      return dx * dy + dy * dz + dz * dx;
+    };
+  };
+
+  //
+  // ノード ni (深さ depth) に idx_[b, e) の三角形を入れて再帰的に構築する
+  //
+  void buildNode( int ni, int b, int e, int depth, ThreadPool& pool ) {
+    int n = e - b;
+
+    // ノードの AABB と重心の範囲
+    Bin box, cbox;
+    auto bound = [&]( int rb, int re, Bin& bb, Bin& cb ) {
+      for ( int k = rb; k < re; ++k ) {
+        const Prim& pr = prims_[ idx_[k] ];
+        bb.add( pr.lo, pr.hi, 1 );
+        cb.add( pr.c, pr.c, 1 );
+      }
+    };
+    if ( n > PARALLEL_SIZE ) {
+      int n_chunks = pool.size() * 4;
+      std::vector<Bin> bbs( n_chunks ), cbs( n_chunks );
+      parallelFor( pool, 0, n_chunks, 1, [&]( int c ) {
+          bound( b + (int) ( (long long) n * c / n_chunks ), b + (int) ( (long long) n * ( c + 1 ) / n_chunks ),
+                 bbs[c], cbs[c] );
+        } );
+      for ( int c = 0; c < n_chunks; ++c ) {
+        box.add( bbs[c].lo, bbs[c].hi, bbs[c].count );
+        cbox.add( cbs[c].lo, cbs[c].hi, cbs[c].count );
+      }
+    } else {
+      bound( b, e, box, cbox );
+    }
+
+    BVHNode& nd = nodes_[ni];
+    for ( int j = 0; j < 3; ++j ) {
+      nd.bbmin[j] = box.lo[j];
+      nd.bbmax[j] = box.hi[j];
+    }
+    nd.axis = 0;
+    nd.pad = 0;
+
+    if ( n <= 1 ) {
+      makeLeaf( nd, b, n );
+      return;
+    }
+
+    // 深いノード: 偏った SAH の分割が続いて木が深くなりすぎないよう，
+    // 重心の範囲が最も長い軸の中央値で半分に分ける
+    if ( depth >= MAX_SAH_DEPTH ) {
+      if ( n <= max_leaf_ ) {
+        makeLeaf( nd, b, n );
+        return;
+      }
+      int axis = 0;
+      for ( int j = 1; j < 3; ++j )
+        if ( cbox.hi[j] - cbox.lo[j] > cbox.hi[axis] - cbox.lo[axis] ) axis = j;
+      int m = b + n / 2;
+      std::nth_element( &( idx_[b] ), &( idx_[m] ), &( idx_[0] ) + e, [&]( int i, int j ) {
+          return prims_[i].c[axis] < prims_[j].c[axis];
+        } );
+      nd.axis = axis;
+      buildChildren( nd, b, m, e, depth, pool );
+      return;
+    }
+
+    // 各軸について重心をビンに分け，SAH が最小になる分割を探す
+    int best_axis = -1, best_split = 0;
+    double best_cost = std::numeric_limits<double>::max();
+    std::vector<Bin> bins( 3 * n_bins_ );
+    auto binning = [&]( int rb, int re, Bin* bs ) {
+      for ( int k = rb; k < re; ++k ) {
+        const Prim& pr = prims_[ idx_[k] ];
+        for ( int j = 0; j < 3; ++j ) {
+          double ext = cbox.hi[j] - cbox.lo[j];
+          if ( !( ext > .0 ) ) continue;
+          bs[ j * n_bins_ + binIndex( pr.c[j], cbox.lo[j], ext ) ].add( pr.lo, pr.hi, 1 );
+        }
+      }
+    };
+    if ( n > PARALLEL_SIZE ) {
+      int n_chunks = pool.size() * 4;
+      std::vector<Bin> cbins( n_chunks * 3 * n_bins_ );
+      parallelFor( pool, 0, n_chunks, 1, [&]( int c ) {
+          binning( b + (int) ( (long long) n * c / n_chunks ), b + (int) ( (long long) n * ( c + 1 ) / n_chunks ),
+                   &( cbins[ c * 3 * n_bins_ ] ) );
+        } );
+      for ( int c = 0; c < n_chunks; ++c )
+        for ( int k = 0; k < 3 * n_bins_; ++k ) {
+          const Bin& cb = cbins[ c * 3 * n_bins_ + k ];
+          if ( cb.count ) bins[k].add( cb.lo, cb.hi, cb.count );
+        }
+    } else {
+      binning( b, e, &( bins[0] ) );
+    }
+
+    double inv_area = 1.0 / std::max( box.area(), std::numeric_limits<double>::min() );
+    std::vector<double> right_cost( n_bins_ );
+    for ( int j = 0; j < 3; ++j ) {
+      if ( !( cbox.hi[j] - cbox.lo[j] > .0 ) ) continue;
+      Bin* bs = &( bins[ j * n_bins_ ] );
+
+      // 右側から累積した面積 x 個数
+      Bin acc;
+      for ( int k = n_bins_ - 1; k > 0; --k ) {
+        if ( bs[k].count ) acc.add( bs[k].lo, bs[k].hi, bs[k].count );
+        right_cost[k] = acc.area() * acc.count;
+      }
+      acc = Bin();
+      for ( int k = 0; k < n_bins_ - 1; ++k ) {
+        if ( bs[k].count ) acc.add( bs[k].lo, bs[k].hi, bs[k].count );
+        double cost = 1.0 + ( acc.area() * acc.count + right_cost[k+1] ) * inv_area;
+        if ( cost < best_cost ) {
+          best_cost = cost;
+          best_axis = j;
+          best_split = k + 1;
+        }
+      }
+    }
+
+    // 分割しない方が安ければ葉にする
+    if ( ( n <= max_leaf_ ) && ( ( best_axis < 0 ) || ( best_cost >= (double) n ) ) ) {
+      makeLeaf( nd, b, n );
+      return;
+    }
+
+    int m;
+    if ( best_axis >= 0 ) {
+      double lo = cbox.lo[ best_axis ], ext = cbox.hi[ best_axis ] - lo;
+      int* mid = std::partition( &( idx_[b] ), &( idx_[0] ) + e, [&]( int i ) {
+          return binIndex( prims_[i].c[ best_axis ], lo, ext ) < best_split;
+        } );
+      m = (int) ( mid - &( idx_[0] ) );
+      nd.axis = best_axis;
+    } else {
+      m = b;
+    }
+    // 重心が重なっていて分けられない場合は半分ずつにする
+    if ( ( m == b ) || ( m == e ) ) m = b + n / 2;
+
+    buildChildren( nd, b, m, e, depth, pool );
+  };
+
+  // ノード nd を idx_[b, m) と idx_[m, e) の 2 つの子に分けて構築する
+  void buildChildren( BVHNode& nd, int b, int m, int e, int depth, ThreadPool& pool ) {
+    int c = n_nodes_.fetch_add( 2 );
+    nd.start = c;
+    nd.count = 0;
+
+    if ( e - b > TASK_SIZE ) {
+      TaskGroup tg( pool );
+      tg.run( [this, c, b, m, depth, &pool]() { buildNode( c, b, m, depth + 1, pool ); } );
+      buildNode( c + 1, m, e, depth + 1, pool );
+      tg.wait();
+    } else {
+      buildNode( c, b, m, depth + 1, pool );
+      buildNode( c + 1, m, e, depth + 1, pool );
+    }
+  };
+
+  void makeLeaf( BVHNode& nd, int b, int n ) {
+    nd.start = b;
+    nd.count = n;
+  };
+
+  int binIndex( double c, double lo, double ext ) const {
+    int k = (int) ( ( c - lo ) * n_bins_ / ext );
+    return std::max( 0, std::min( k, n_bins_ - 1 ) );
+  };
+
+  // レイとノードのボックスの交差判定 (スラブ法)．[0, tmax] と重なれば入口を t_near に返す
+  static bool rayBox( const BVHNode& nd, const double orig[3], const double inv[3],
+                      double tmax, double& t_near ) {
+    double t0 = .0, t1 = tmax;
+    for ( int j = 0; j < 3; ++j ) {
+      double ta = ( nd.bbmin[j] - orig[j] ) * inv[j];
+      double tb = ( nd.bbmax[j] - orig[j] ) * inv[j];
+      t0 = std::max( t0, std::min( ta, tb ) );
+      t1 = std::min( t1, std::max( ta, tb ) );
+    }
+    t_near = t0;
+    return ( t0 <= t1 ) ? true : false;
+  };
+
+  // 点 p からノードのボックスまでの距離の 2 乗
+  static double boxDistance2( const BVHNode& nd, const Eigen::Vector3d& p ) {
+    double d2 = .0;
+    for ( int j = 0; j < 3; ++j ) {
+      if ( p[j] < nd.bbmin[j] ) d2 += ( nd.bbmin[j] - p[j] ) * ( nd.bbmin[j] - p[j] );
+      else if ( p[j] > nd.bbmax[j] ) d2 += ( p[j] - nd.bbmax[j] ) * ( p[j] - nd.bbmax[j] );
+    }
+    return d2;
+  };
+
+  // ビンの集計を並列にするノードの大きさと，子をタスクにするノードの大きさ
+  enum { PARALLEL_SIZE = 65536, TASK_SIZE = 4096 };
+
+  int max_leaf_;
+  int n_bins_;
+
+  std::vector<BVHNode> nodes_;
+  std::atomic<int> n_nodes_;
+  std::vector<OctreeTri> tris_;
+  std::vector<FaceL*> faces_;
+
+  // 構築中のみ使う
+  std::vector<Prim> prims_;
+  std::vector<int> idx_;
+};
+
+#endif // _BVH_HXX
@@ -2,6 +2,7 @@
 #define _GLOCTREE_HXX 1
 
 #include "Octree.hxx"
+#include "OctreeCache.hxx"
 
 class GLOctree {
 
@@ -14,12 +15,30 @@ public:
     // 最大レベルを超えたら描画しない
     if ( node->level() > MAX_LEVEL ) return;
 
+    drawBox( node->getBBmin(), node->getBBmax() );
+
+    for ( int i = 0; i < 8; ++i ) drawOctree( node->child(i) );
+  };
+
+  // キャッシュからマップした octree (ノード i 以下) の描画
+  void drawOctree( OctreeCache& cache, int i = 0 ) {
+
+    if ( !cache.isLoaded() ) return;
+
+    const OctreeCacheNode& nd = cache.node( i );
+    drawBox( Eigen::Vector3d( nd.bbmin[0], nd.bbmin[1], nd.bbmin[2] ),
+             Eigen::Vector3d( nd.bbmax[0], nd.bbmax[1], nd.bbmax[2] ) );
+
+    for ( int j = 0; j < 8; ++j ) if ( nd.child[j] >= 0 ) drawOctree( cache, nd.child[j] );
+  };
+
+private:
+
+  void drawBox( const Eigen::Vector3d& bbmin, const Eigen::Vector3d& bbmax ) {
+
     glLineWidth( 1.0f );
     glColor3f( 0.0f, 1.0f, 0.0f );
 
-    Eigen::Vector3d& bbmin = node->getBBmin();
-    Eigen::Vector3d& bbmax = node->getBBmax();
-
     glBegin( GL_LINE_LOOP );
     glVertex3d( bbmin.x(), bbmin.y(), bbmin.z() );
     glVertex3d( bbmax.x(), bbmin.y(), bbmin.z() );
@@ -53,8 +72,6 @@ public:
     glVertex3d( bbmax.x(), bbmin.y(), bbmin.z() );
     glVertex3d( bbmax.x(), bbmin.y(), bbmax.z() );
     glEnd();
-  
-    for ( int i = 0; i < 8; ++i ) drawOctree( node->child(i) );
   };
 
 };
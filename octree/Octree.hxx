@@ -10,31 +10,85 @@
 #define _OCTREE_HXX 1
 
 #include <vector>
+#include <list>
 #include <limits>
+#include <algorithm>
+#include <queue>
+#include <atomic>
+#include <iterator>
+#include <set>
+#include <cmath>
 using namespace std;
 
 #include "myEigen.hxx"
 #include "FaceL.hxx"
+#include "VMProc.hxx"
 
 #define  MAX_LEVEL 5
+// refit() で作り直しを判断する部分木の深さ
+#define  REFIT_LEVEL 2
+// refit() で葉を求め直す面がこの割合を超えたら木全体を作り直す
+#define  REFIT_BUILD_RATIO 0.3
+// refit() で葉を求め直す面の割合を見積もるときの間引き (この枚数に 1 枚を調べる)
+#define  REFIT_SAMPLE 16
+// refit() でボックスを作り直すときに広げる割合 (各辺の長さに対して)
+#define  REFIT_MARGIN 0.05
 
 #include "tribox3.h"
 #include "raytri.h"
 
+#include "OctreeTri.hxx"
+#include "RayHit.hxx"
+#include "RayPacket.hxx"
+#include "ThreadPool.hxx"
+#include "Accelerator.hxx"
+
+//
+// Octree::refit() の結果
+//
+struct OctreeRefitStats {
+  int moved;              // 頂点が動いた面の数
+  int refitted;           // 葉のレコードの更新だけで済んだ面の数
+  int rebinned;           // 入る葉が変わったため葉を入れ替えた面の数
+  int leaves_touched;     // 更新した葉の数
+  int subtrees_rebuilt;   // 作り直した部分木の数
+  bool rebuilt;           // 木全体を作り直したかどうか
+
+  OctreeRefitStats() : moved(0), refitted(0), rebinned(0),
+                       leaves_touched(0), subtrees_rebuilt(0), rebuilt(false) {};
+};
+
 // Octree のノードのクラス
-class Octree {
+// 問い合わせは Accelerator のインタフェースで BVH と切り替えられる
+class Octree : public Accelerator {
 
 public:
 
   Octree(){ init(); };
   Octree( Eigen::Vector3d& bbmin, Eigen::Vector3d& bbmax ) { init(); setBB( bbmin, bbmax ); };
+  ~Octree() { clearChildren(); };
 
   // parent_ と child_[8] ノードの初期化
   void init() {
+    level_ = 0;
+    root_ = this;
+    stats_ = false;
+    n_tested_ = 0;
+    n_skipped_ = 0;
     parent_ = NULL;
     for ( int i = 0; i < 8; ++i ) child_[i] = NULL;
   };
 
+  const char* name() const { return "Octree"; };
+
+  // 子ノードの削除
+  void clearChildren() {
+    for ( int i = 0; i < 8; ++i ) {
+      delete child_[i];
+      child_[i] = NULL;
+    }
+  };
+
   // Bounding Box (bbmin, bbmax) への値のセット
   void setBB( Eigen::Vector3d& bbmin, Eigen::Vector3d& bbmax ) {
     bbmin_ = bbmin;
@@ -51,8 +105,19 @@ public:
 
   // ノードの面リストへの面データの追加
   void addFaceList( FaceL* fc ) {
-    flist_.push_back( fc );
+    OctreeTri tri;
+    root_->registerFace( fc, tri );
+    tris_.push_back( tri );
   };
+  void addTriList( const OctreeTri& tri ) { tris_.push_back( tri ); };
+
+  // ノードに格納された三角形のレコード
+  int tris_size() const { return (int) tris_.size(); };
+  const OctreeTri& tri( int i ) const { return tris_[i]; };
+
+  // 三角形のレコードの id に対応する面 (ルートの面の表)
+  FaceL* face( int id ) const { return root_->faces_[id]; };
+  int faces_size() const { return (int) root_->faces_.size(); };
 
   Octree* child( int id ) { return child_[id]; };
 
@@ -65,6 +130,7 @@ public:
     Octree* child = new Octree( bbmin, bbmax );
     child->setParent( this );
     child->setLevel( level_ + 1 );
+    child->root_ = root_;
 
     child_[id] = child;
 
@@ -146,10 +212,17 @@ public:
   // node->child[i] の中に fc が入っているかどうか調べ
   // 入っていれば node->child[i] を再帰的に調べる．
   // あるレベルに到達したときに face list に加える．
+  // 面の頂点は最初に一度だけ三角形のレコードに取り出し，以降はそれを使う
   //
   void addFaceToOctree( FaceL* fc ) {
+    OctreeTri tri;
+    root_->registerFace( fc, tri );
+    addTriToOctree( tri );
+  };
+
+  void addTriToOctree( const OctreeTri& tri ) {
     if ( level_ == MAX_LEVEL ) {
-      addFaceList( fc );
+      addTriList( tri );
       return;
     }
 
@@ -157,12 +230,286 @@ public:
       // 面 fc が 子供の範囲内に入っているかどうかをチェック
       Eigen::Vector3d bbmin, bbmax;
       calcChildRange( i, bbmin, bbmax );
-      if ( isFaceOveralapBox( fc, bbmin, bbmax ) ) { // 入っている場合
+      if ( isFaceOveralapBox( tri, bbmin, bbmax ) ) { // 入っている場合
         // child[i] がなければ作成
         if ( child_[i] == NULL ) child_[i] = addChild( i );
-        child_[i]->addFaceToOctree( fc );
+        child_[i]->addTriToOctree( tri );
+      }
+    }
+  };
+
+  //
+  // 面の集合からまとめて木を構築する (setBB() で範囲をセットしてから呼ぶ)
+  // - 各ノードで面を 8 個の子に一度に振り分け，子ノードはタスクとして並列に構築する
+  // - 三角形の AABB が子のボックスと重ならなければ SAT (triBoxOverlap) を省く
+  // - 得られる木は addFaceToOctree() で 1 枚ずつ入れた場合と同じになる
+  //
+  void build( const std::vector<FaceL*>& faces, ThreadPool& pool = ThreadPool::instance() ) {
+    clearChildren();
+    tris_.clear();
+    faces_ = faces;
+
+    int n = (int) faces_.size();
+    ftris_.resize( n );
+    parallelFor( pool, 0, n, 1024, [&]( int i ) { ftris_[i].set( faces_[i], i ); } );
+    buildTris( pool );
+  };
+
+  void build( std::list<FaceL*>& faces, ThreadPool& pool = ThreadPool::instance() ) {
+    std::vector<FaceL*> fv( faces.begin(), faces.end() );
+    build( fv, pool );
+  };
+
+  //
+  // 面の頂点が動いた後に木を更新する (ルートで呼ぶ．面の追加・削除には対応しない)
+  // - 三角形の AABB が掛かる深さ MAX_LEVEL のセルの範囲が変わらず，その範囲が 1 列のセル (cellLine())
+  //   なら入る葉は変わらないので，葉の三角形のレコードを更新するだけにする (SAT による判定を省く)
+  // - それ以外の動いた面は重なる葉を求め直し，抜けた葉から削除し，新たに重なる葉に追加する
+  //   葉を求め直す面が面の数の REFIT_BUILD_RATIO 倍を超えたら，木全体を作り直す
+  //   (全体が大きく動いた場合は葉を求め直すより作り直す方が速い．割合は間引いた面で先に見積もる)
+  // - 深さ REFIT_LEVEL の部分木のうち，入れ替えが面の数の rebuild_ratio 倍を超えたものは
+  //   部分木ごと作り直す
+  // - 頂点がルートのボックスの外に出た場合は，ボックスを計算し直して木全体を作り直す
+  //   ボックスは大きさの REFIT_MARGIN 倍だけ広げ，少しずつ広がるメッシュで毎回作り直さないようにする
+  //
+  OctreeRefitStats refit( double rebuild_ratio = 0.25, ThreadPool& pool = ThreadPool::instance() ) {
+    OctreeRefitStats stats;
+    int n = (int) faces_.size();
+
+    // 新しいレコードと動いた面
+    std::vector<OctreeTri> ntris( n );
+    std::vector<char> moved( n );
+    parallelFor( pool, 0, n, 1024, [&]( int i ) {
+        ntris[i].set( faces_[i], i );
+        moved[i] = ntris[i].same( ftris_[i] ) ? 0 : 1;
+      } );
+
+    Eigen::Vector3d bbmin = bbmin_, bbmax = bbmax_;
+    for ( int i = 0; i < n; ++i ) {
+      if ( !moved[i] ) continue;
+      ++( stats.moved );
+      for ( int k = 0; k < 3; ++k ) {
+        Eigen::Vector3d p = ntris[i].point( k );
+        bbmin = bbmin.cwiseMin( p );
+        bbmax = bbmax.cwiseMax( p );
+      }
+    }
+    if ( stats.moved == 0 ) return stats;
+
+    // ルートのボックスの外に出た: ボックスを余裕を持たせて計算し直し，全体を作り直す
+    // (頂点を v0 + e1 で戻したときの丸め誤差は許す)
+    double eps = cullEps();
+    Eigen::Vector3d tol( eps, eps, eps );
+    if ( ( ( bbmin_ - tol ).cwiseMax( bbmin ) != bbmin ) || ( ( bbmax_ + tol ).cwiseMin( bbmax ) != bbmax ) ) {
+      bbmin = ntris[0].point( 0 );
+      bbmax = bbmin;
+      for ( int i = 0; i < n; ++i ) {
+        for ( int k = 0; k < 3; ++k ) {
+          Eigen::Vector3d p = ntris[i].point( k );
+          bbmin = bbmin.cwiseMin( p );
+          bbmax = bbmax.cwiseMax( p );
+        }
+      }
+      Eigen::Vector3d margin = REFIT_MARGIN * ( bbmax - bbmin );
+      bbmin -= margin;
+      bbmax += margin;
+      setBB( bbmin, bbmax );
+      ftris_.swap( ntris );
+      buildTris( pool );
+      stats.rebuilt = true;
+      return stats;
+    }
+
+    // 入る葉を求め直す面 slow と，その番号 slot[i] (求め直さない面は -1)
+    // 先に REFIT_SAMPLE 枚に 1 枚の割合で数え，多すぎれば全体を調べずに作り直す
+    std::vector<double> grid[3];
+    cellGrid( grid );
+    auto isSlow = [&]( int i ) {
+      int a0[3], a1[3], b0[3], b1[3];
+      if ( !cellLine( ftris_[i], grid, eps, a0, a1 ) || !cellLine( ntris[i], grid, eps, b0, b1 ) ) return true;
+      for ( int j = 0; j < 3; ++j ) {
+        if ( ( a0[j] != b0[j] ) || ( a1[j] != b1[j] ) ) return true;
+      }
+      return false;
+    };
+    int n_sample = 0;
+    for ( int i = 0; i < n; i += REFIT_SAMPLE ) {
+      if ( moved[i] && isSlow( i ) ) ++n_sample;
+    }
+    bool too_many = ( n_sample * REFIT_SAMPLE > REFIT_BUILD_RATIO * n );
+
+    std::vector<int> slot( n, -1 );
+    std::vector<int> slow;
+    if ( !too_many ) {
+      parallelFor( pool, 0, n, 1024, [&]( int i ) {
+          if ( moved[i] && isSlow( i ) ) slot[i] = 0;
+        } );
+      for ( int i = 0; i < n; ++i ) {
+        if ( slot[i] < 0 ) continue;
+        slot[i] = (int) slow.size();
+        slow.push_back( i );
+      }
+      too_many = ( slow.size() > REFIT_BUILD_RATIO * n );
+    }
+    if ( too_many ) {
+      ftris_.swap( ntris );
+      buildTris( pool );
+      stats.rebuilt = true;
+      return stats;
+    }
+    int n_slow = (int) slow.size();
+
+    //
+    // 求め直した葉の番号: slow[s] の葉は codes[ code_off[s] ... code_off[s+1]-1 ] (昇順)
+    // 区間ごとに求めてからつなげる
+    //
+    const int chunk = 256;
+    int n_chunks = ( n_slow + chunk - 1 ) / chunk;
+    std::vector<std::vector<int> > chunk_codes( n_chunks );
+    std::vector<int> code_off( n_slow + 1, 0 );
+    parallelFor( pool, 0, n_chunks, 1, [&]( int c ) {
+        for ( int s = c * chunk; s < std::min( n_slow, ( c + 1 ) * chunk ); ++s ) {
+          size_t m = chunk_codes[c].size();
+          triLeafCodes( ntris[ slow[s] ], grid, eps, chunk_codes[c] );
+          code_off[ s + 1 ] = (int) ( chunk_codes[c].size() - m );
+        }
+      } );
+    for ( int s = 0; s < n_slow; ++s ) code_off[ s + 1 ] += code_off[s];
+    std::vector<int> codes;
+    codes.reserve( code_off[ n_slow ] );
+    for ( int c = 0; c < n_chunks; ++c ) codes.insert( codes.end(), chunk_codes[c].begin(), chunk_codes[c].end() );
+    std::vector<std::vector<int> >().swap( chunk_codes );
+    // 面と葉の組がもとの葉に残っていれば 1
+    std::vector<char> present( codes.size(), 0 );
+
+    ftris_.swap( ntris );
+
+    //
+    // 葉ごとに，動いた面のレコードを更新し，重ならなくなった面を削除する
+    // 残った面は present に印を付ける (面と葉の組は一度しか現れないので競合しない)
+    //
+    std::vector<Octree*> leaves;
+    std::vector<int> leaf_codes;
+    collectLeaves( 0, leaves, leaf_codes );
+    std::vector<std::vector<int> > removed( leaves.size() );
+    parallelFor( pool, 0, (int) leaves.size(), 16, [&]( int j ) {
+        std::vector<OctreeTri>& lt = leaves[j]->tris_;
+        int m = 0;
+        for ( int l = 0; l < lt.size(); ++l ) {
+          int id = lt[l].id;
+          if ( moved[id] ) {
+            int s = slot[id];
+            if ( s >= 0 ) {
+              std::vector<int>::iterator b = codes.begin() + code_off[s], e = codes.begin() + code_off[ s + 1 ];
+              std::vector<int>::iterator it = std::lower_bound( b, e, leaf_codes[j] );
+              if ( ( it == e ) || ( *it != leaf_codes[j] ) ) {
+                removed[j].push_back( id );
+                continue;
+              }
+              present[ it - codes.begin() ] = 1;
+            }
+            lt[m++] = ftris_[id];
+          } else {
+            if ( m != l ) lt[m] = lt[l];
+            ++m;
+          }
+        }
+        lt.resize( m );
+      } );
+
+    // 入る葉が変わった面と，深さ REFIT_LEVEL の部分木ごとの入れ替えの数
+    const int n_sub = 1 << ( 3 * REFIT_LEVEL );
+    const int sub_shift = 3 * ( MAX_LEVEL - REFIT_LEVEL );
+    std::vector<int> sub_tris( n_sub, 0 ), sub_diff( n_sub, 0 );
+    std::vector<char> changed( n, 0 );
+    for ( int j = 0; j < leaves.size(); ++j ) {
+      int k = leaf_codes[j] >> sub_shift;
+      sub_tris[k] += leaves[j]->tris_size() + (int) removed[j].size();
+      sub_diff[k] += (int) removed[j].size();
+      for ( int l = 0; l < removed[j].size(); ++l ) changed[ removed[j][l] ] = 1;
+    }
+    stats.refitted = stats.moved - n_slow;
+    for ( int s = 0; s < n_slow; ++s ) {
+      int i = slow[s];
+      for ( int c = code_off[s]; c < code_off[ s + 1 ]; ++c ) {
+        if ( present[c] ) continue;
+        changed[i] = 1;
+        ++( sub_diff[ codes[c] >> sub_shift ] );
+      }
+      if ( changed[i] ) ++( stats.rebinned ); else ++( stats.refitted );
+    }
+
+    std::vector<char> rebuild( n_sub, 0 );
+    for ( int k = 0; k < n_sub; ++k ) {
+      if ( sub_diff[k] > rebuild_ratio * std::max( sub_tris[k], 1 ) ) {
+        rebuild[k] = 1;
+        ++( stats.subtrees_rebuilt );
+      }
+    }
+
+    std::set<Octree*> touched;
+    for ( int j = 0; j < leaves.size(); ++j ) {
+      if ( rebuild[ leaf_codes[j] >> sub_shift ] ) continue;
+      if ( !removed[j].empty() ) { touched.insert( leaves[j] ); continue; }
+      std::vector<OctreeTri>& lt = leaves[j]->tris_;
+      for ( int l = 0; l < lt.size(); ++l ) {
+        if ( moved[ lt[l].id ] ) { touched.insert( leaves[j] ); break; }
+      }
+    }
+
+    // 作り直す部分木: 葉を求め直さない面はもとの葉から，求め直した面は新しい葉の番号から集める
+    if ( stats.subtrees_rebuilt ) {
+      std::vector<std::vector<int> > sub_idx( n_sub );
+      for ( int j = 0; j < leaves.size(); ++j ) {
+        int k = leaf_codes[j] >> sub_shift;
+        if ( !rebuild[k] ) continue;
+        for ( int l = 0; l < leaves[j]->tris_size(); ++l ) {
+          int id = leaves[j]->tri( l ).id;
+          if ( slot[id] < 0 ) sub_idx[k].push_back( id );
+        }
+      }
+      for ( int s = 0; s < n_slow; ++s ) {
+        int last = -1;
+        for ( int c = code_off[s]; c < code_off[ s + 1 ]; ++c ) {
+          int k = codes[c] >> sub_shift;
+          if ( rebuild[k] && ( k != last ) ) sub_idx[k].push_back( slow[s] );
+          last = k;
+        }
+      }
+
+      // 部分木の根の親までのノードは先に作っておく
+      TaskGroup tg( pool );
+      for ( int k = 0; k < n_sub; ++k ) {
+        if ( !rebuild[k] ) continue;
+        std::sort( sub_idx[k].begin(), sub_idx[k].end() );
+        sub_idx[k].erase( std::unique( sub_idx[k].begin(), sub_idx[k].end() ), sub_idx[k].end() );
+
+        Octree* parent = leafNode( k >> 3, REFIT_LEVEL - 1 );
+        int id = k & 7;
+        delete parent->child_[id];
+        parent->child_[id] = NULL;
+        if ( sub_idx[k].empty() ) continue;
+        Octree* sub = parent->addChild( id );
+        std::vector<int>* idx = &( sub_idx[k] );
+        tg.run( [this, sub, idx, eps, &pool]() { sub->buildNode( ftris_, *idx, eps, pool ); } );
       }
+      tg.wait();
     }
+
+    // 新たに重なった葉への追加
+    for ( int s = 0; s < n_slow; ++s ) {
+      int i = slow[s];
+      if ( !changed[i] ) continue;
+      for ( int c = code_off[s]; c < code_off[ s + 1 ]; ++c ) {
+        if ( present[c] || rebuild[ codes[c] >> sub_shift ] ) continue;
+        Octree* leaf = leafNode( codes[c], MAX_LEVEL );
+        leaf->tris_.push_back( ftris_[i] );
+        touched.insert( leaf );
+      }
+    }
+    stats.leaves_touched = (int) touched.size();
+
+    return stats;
   };
 
   //
@@ -192,6 +539,22 @@ public:
     return triBoxOverlap( boxcenter, boxhalfsize, triverts );
   };
 
+  // 三角形のレコードを使う版
+  bool isFaceOveralapBox( const OctreeTri& tri, Eigen::Vector3d& bbmin, Eigen::Vector3d& bbmax ) {
+
+    float boxcenter[3], boxhalfsize[3];
+    float triverts[3][3];
+    for ( int j = 0; j < 3; ++j ) {
+      boxcenter[j] = (float) ( bbmax[j] + bbmin[j] ) / 2.0f;
+      boxhalfsize[j] = (float) ( bbmax[j] - bbmin[j] ) / 2.0f;
+      triverts[0][j] = (float) tri.v0[j];
+      triverts[1][j] = (float) ( tri.v0[j] + tri.e1[j] );
+      triverts[2][j] = (float) ( tri.v0[j] + tri.e2[j] );
+    }
+
+    return triBoxOverlap( boxcenter, boxhalfsize, triverts );
+  };
+
   // 直線とボックスの交差判定
   // http://marupeke296.com/COL_3D_No18_LineAndAABB.html
   bool isRayIntersect( Eigen::Vector3d& pos, Eigen::Vector3d& dir ) {
@@ -225,64 +588,578 @@ public:
     return true;
   };
 
-  // ray と flist_ に入っている面との交差判定
+  // レイとボックスの交差区間 [t_near, t_far] の計算 (スラブ法)
+  // inv_dir: レイの方向の各成分の逆数
+  bool rayBoxRange( const Eigen::Vector3d& pos, const Eigen::Vector3d& inv_dir,
+                    double& t_near, double& t_far ) const {
+    for ( int i = 0; i < 3; ++i ) {
+      double t1 = (bbmin_[i] - pos[i]) * inv_dir[i];
+      double t2 = (bbmax_[i] - pos[i]) * inv_dir[i];
+      // 方向成分が 0 でボックス面上に始点がある場合の NaN は無視される
+      t_near = std::max( t_near, std::min( t1, t2 ) );
+      t_far  = std::min( t_far,  std::max( t1, t2 ) );
+      if ( t_near > t_far ) return false;
+    }
+    return true;
+  };
+
+  // レイと面 fc (三角形) との交差判定
+  bool intersectRayFace( FaceL* fc, const Eigen::Vector3d& pos, const Eigen::Vector3d& dir,
+                         double* t, double* u, double* v ) {
+    double orig[3], ddir[3], vert[3][3];
+    orig[0] = pos.x(); orig[1] = pos.y(); orig[2] = pos.z();
+    ddir[0] = dir.x(); ddir[1] = dir.y(); ddir[2] = dir.z();
+    int j = 0;
+    for ( auto he : fc->halfedges() ) {
+      Eigen::Vector3d& p = he->vertex()->point();
+      vert[j][0] = p.x();
+      vert[j][1] = p.y();
+      vert[j][2] = p.z();
+      if ( ++j == 3 ) break;
+    }
+    return ( intersect_triangle2( orig, ddir, vert[0], vert[1], vert[2], t, u, v ) ) ? true : false;
+  };
+
+  // レイと三角形のレコードとの交差判定
+  bool intersectRayTri( const OctreeTri& tri, const Eigen::Vector3d& pos, const Eigen::Vector3d& dir,
+                        double* t, double* u, double* v ) const {
+    double orig[3], ddir[3];
+    orig[0] = pos.x(); orig[1] = pos.y(); orig[2] = pos.z();
+    ddir[0] = dir.x(); ddir[1] = dir.y(); ddir[2] = dir.z();
+    return ( intersect_triangle2_edge( orig, ddir, tri.v0, tri.e1, tri.e2, t, u, v ) ) ? true : false;
+  };
+
+  // ray と tris_ に入っている面との交差判定
   // 複数入っている場合は，pos に一番近い点を出力する
   FaceL* intersectRayFaces( Eigen::Vector3d& pos, Eigen::Vector3d& dir,
                             Eigen::Vector3d& near_p ) {
 
-    FaceL* near_fc = NULL;
-    for (int i = 0; i < flist_.size(); ++i ) {
-      FaceL* fc = flist_[i];
-      double orig[3], ddir[3], vert0[3], vert1[3], vert2[3];
-      orig[0] = pos.x(); orig[1] = pos.y(); orig[2] = pos.z();
-      ddir[0] = dir.x(); ddir[1] = dir.y(); ddir[2] = dir.z();
-      int j = 0;
-      Eigen::Vector3d p0, p1, p2;
-      for ( auto he : fc->halfedges() ) {
-        if (j == 0) {
-          p0 = he->vertex()->point();
-          vert0[0] = p0.x();
-          vert0[1] = p0.y();
-          vert0[2] = p0.z();
-        } else if (j == 1) {
-          p1 = he->vertex()->point();
-          vert1[0] = p1.x();
-          vert1[1] = p1.y();
-          vert1[2] = p1.z();
-        } else if (j == 2) {
-          p2 = he->vertex()->point();
-          vert2[0] = p2.x();
-          vert2[1] = p2.y();
-          vert2[2] = p2.z();
-        }
-        ++j;
+    RayHit hit;
+    intersectRayFaces( pos, dir, hit );
+    if ( hit.isHit() ) near_p = pos + hit.t * dir;
+
+    return hit.face;
+  };
+
+  // tris_ の面のうち，[0, hit.t) の範囲で最も近い交点を hit に記録する
+  void intersectRayFaces( const Eigen::Vector3d& pos, const Eigen::Vector3d& dir, RayHit& hit ) {
+    TriMailbox mb;
+    intersectRayFaces( pos, dir, hit, mb );
+  };
+
+  // mb に記録された判定済みの三角形は飛ばす
+  void intersectRayFaces( const Eigen::Vector3d& pos, const Eigen::Vector3d& dir, RayHit& hit,
+                          TriMailbox& mb ) {
+    for ( int i = 0; i < tris_.size(); ++i ) {
+      if ( mb.visited( tris_[i].id ) ) continue;
+      double t, u, v;
+      if ( intersectRayTri( tris_[i], pos, dir, &t, &u, &v )
+           && ( t >= .0 ) && ( t < hit.t ) ) {
+        hit.face = face( tris_[i].id );
+        hit.t = t;
+        hit.u = u;
+        hit.v = v;
       }
-      double t,u,v;
-      if ( intersect_triangle2(orig, ddir, vert0, vert1, vert2,
-                               &t, &u, &v) ) {
-        Eigen::Vector3d p = (1.0-u-v) * p0 + u * p1 + v * p2;
-        if ( near_fc != NULL ) {
-          if ( (pos - near_p).norm() > (pos - p).norm() ) {
-            near_fc = fc;
-            near_p = p;
-          }
-        } else {
-          near_fc = fc;
-          near_p = p;
+    }
+  };
+
+  //
+  // レイ origin + t * dir (0 <= t <= tmax) とメッシュとの最近交点を求める
+  // - 子ノードをレイが入る順 (front-to-back) に辿り，
+  //   見つかった交点が次のノードの入口より手前にあれば探索を打ち切る
+  //
+  RayHit raycast( const Eigen::Vector3d& origin, const Eigen::Vector3d& dir,
+                  double tmax = std::numeric_limits<double>::max() ) {
+    RayHit hit;
+    hit.t = tmax;
+
+    Eigen::Vector3d inv_dir = dir.cwiseInverse();
+    double t_near = .0, t_far = tmax;
+    if ( rayBoxRange( origin, inv_dir, t_near, t_far ) ) {
+      TriMailbox mb;
+      raycastNode( origin, dir, inv_dir, hit, mb );
+      addStats( mb );
+    }
+
+    if ( !hit.isHit() ) hit.t = std::numeric_limits<double>::max();
+    return hit;
+  };
+
+  //
+  // シャドウレイ用: [0, tmax] の範囲にひとつでも交点があれば true を返す
+  //
+  bool anyHit( const Eigen::Vector3d& origin, const Eigen::Vector3d& dir,
+               double tmax = std::numeric_limits<double>::max() ) {
+    Eigen::Vector3d inv_dir = dir.cwiseInverse();
+    double t_near = .0, t_far = tmax;
+    if ( !rayBoxRange( origin, inv_dir, t_near, t_far ) ) return false;
+    TriMailbox mb;
+    bool hit = anyHitNode( origin, dir, inv_dir, tmax, mb );
+    addStats( mb );
+    return hit;
+  };
+
+  //
+  // 複数のレイの最近交点をまとめて求める
+  // - origins[i] + t * dirs[i] (0 <= t <= tmax) の結果を hits[i] に格納する
+  // - 木は読み出しのみなので，レイの区間ごとにスレッドプールで並列に処理する
+  // - AVX2 でビルドした場合 (RAYPACKET_SIMD) は，区間内の連続する 8 本をレイパケットとして処理する
+  //
+  void raycastBatch( const std::vector<Eigen::Vector3d>& origins,
+                     const std::vector<Eigen::Vector3d>& dirs,
+                     std::vector<RayHit>& hits,
+                     double tmax = std::numeric_limits<double>::max(),
+                     ThreadPool& pool = ThreadPool::instance() ) {
+    int n = (int) std::min( origins.size(), dirs.size() );
+    hits.resize( n );
+    parallelForRange( pool, 0, n, 256, [&]( int b, int e ) {
+        int i = b;
+        for ( ; RAYPACKET_SIMD && ( i + 8 <= e ); i += 8 ) {
+          RayPacket8 rp;
+          for ( int k = 0; k < 8; ++k ) rp.set( k, origins[i+k], dirs[i+k], tmax );
+          raycastPacket( rp );
+          for ( int k = 0; k < 8; ++k ) hits[i+k] = rp.hit( k );
+        }
+        for ( ; i < e; ++i ) hits[i] = raycast( origins[i], dirs[i], tmax );
+      } );
+  };
+
+
+  //
+  // レイパケット (K 本のコヒーレントなレイ) の最近交点を求める
+  // - 全レーンの方向の符号が揃っていれば，その向きで決まる順に子ノードを辿り，
+  //   ボックスと交差するレーンだけをマスクで残して探索する
+  // - 符号が揃っていなければレイ 1 本ずつの raycast() で処理する
+  // 結果は rp.hit(i) で取得する
+  //
+  template <int K>
+  void raycastPacket( RayPacket<K>& rp ) {
+    int octant = rp.signOctant();
+    if ( octant < 0 ) {
+      for ( int i = 0; i < K; ++i ) {
+        RayHit hit = raycast( rp.origin(i), rp.dir(i), rp.t[i] );
+        if ( hit.isHit() ) {
+          rp.t[i] = hit.t;
+          rp.u[i] = hit.u;
+          rp.v[i] = hit.v;
+          rp.face[i] = hit.face;
         }
       }
+      return;
+    }
+
+    unsigned int mask = rp.intersectBox( bbmin_, bbmax_, RayPacket<K>::fullMask() );
+    if ( mask ) {
+      TriMailbox mb;
+      raycastPacketNode( rp, mask, octant, mb );
+      addStats( mb );
+    }
+  };
+
+  //
+  // 点 p に最も近いメッシュ上の点を求める (距離が max_dist 以上のものは探さない)
+  // - ボックスまでの距離をキーとする優先度付きキューで近いノードから調べ (best-first)，
+  //   キューの先頭が現在の最近点より遠くなった時点で打ち切る
+  //
+  ClosestHit closestPoint( const Eigen::Vector3d& p,
+                           double max_dist = std::numeric_limits<double>::max() ) {
+    ClosestHit hit;
+    hit.distance = max_dist;
+
+    TriMailbox mb;
+    typedef std::pair<double, Octree*> QNode;
+    std::priority_queue<QNode, std::vector<QNode>, std::greater<QNode> > queue;
+    queue.push( QNode( boxDistance2( p ), this ) );
+
+    while ( !queue.empty() ) {
+      QNode top = queue.top();
+      queue.pop();
+      if ( top.first >= hit.distance * hit.distance ) break;
+
+      Octree* node = top.second;
+      for ( int i = 0; i < node->tris_.size(); ++i ) {
+        if ( !mb.visited( node->tris_[i].id ) ) node->closestPointTri( node->tris_[i], p, hit );
+      }
+
+      for ( int i = 0; i < 8; ++i ) {
+        Octree* child = node->child_[i];
+        if ( child == NULL ) continue;
+        double d2 = child->boxDistance2( p );
+        if ( d2 < hit.distance * hit.distance ) queue.push( QNode( d2, child ) );
+      }
     }
 
-    return near_fc;
+    addStats( mb );
+    if ( !hit.isHit() ) hit.distance = std::numeric_limits<double>::max();
+    return hit;
+  };
+
+
+  //
+  // 問い合わせの統計 (ルートで集計)
+  // - setStats( true ) にしたときだけ集計する．集計はルートの atomic 変数への加算なので，
+  //   バッチ処理では全スレッドが同じキャッシュラインを書き換えて遅くなる (既定は false)
+  // - triTests(): 実際に行った三角形の判定の数
+  // - triTestsSkipped(): 複数の葉に入っている三角形のうち，メールボックスにより省いた判定の数
+  //
+  void setStats( bool f ) { root_->stats_ = f; };
+  bool isStats() const { return root_->stats_; };
+  long long triTests() const { return root_->n_tested_.load(); };
+  long long triTestsSkipped() const { return root_->n_skipped_.load(); };
+  void resetStats() {
+    root_->n_tested_ = 0;
+    root_->n_skipped_ = 0;
+  };
+
+  // 点 p からボックスまでの距離の 2 乗 (p がボックス内なら 0)
+  double boxDistance2( const Eigen::Vector3d& p ) const {
+    double d2 = .0;
+    for ( int i = 0; i < 3; ++i ) {
+      if ( p[i] < bbmin_[i] ) d2 += (bbmin_[i] - p[i]) * (bbmin_[i] - p[i]);
+      else if ( p[i] > bbmax_[i] ) d2 += (p[i] - bbmax_[i]) * (p[i] - bbmax_[i]);
+    }
+    return d2;
   };
 
 private:
 
+  // 三角形 tri 上の p の最近点が hit より近ければ hit を更新する
+  void closestPointTri( const OctreeTri& tri, const Eigen::Vector3d& p, ClosestHit& hit ) {
+    Eigen::Vector3d q;
+    double bc[3];
+    double d = triClosestPoint( p, tri.point(0), tri.point(1), tri.point(2), q, bc );
+    if ( d < hit.distance ) {
+      hit.face = face( tri.id );
+      hit.point = q;
+      hit.distance = d;
+      hit.bc[0] = bc[0]; hit.bc[1] = bc[1]; hit.bc[2] = bc[2];
+    }
+  };
+
+  // raycastPacket() の再帰関数
+  template <int K>
+  void raycastPacketNode( RayPacket<K>& rp, unsigned int mask, int octant, TriMailbox& mb ) {
+    // 三角形のレコードはパケット内の全レイで共有する
+    for ( int i = 0; i < tris_.size(); ++i ) {
+      const OctreeTri& tri = tris_[i];
+      unsigned int m = mb.untested( tri.id, mask );
+      if ( m ) rp.intersectTriangle( tri.v0, tri.e1, tri.e2, face( tri.id ), m );
+    }
+
+    //
+    // 子ノードの番号は bit0: x, bit1: y, bit2: z 方向の上側を表すので，
+    // 方向の符号 octant との排他的論理和の順に辿れば手前から奥の順になる
+    //
+    for ( int i = 0; i < 8; ++i ) {
+      Octree* child = child_[ i ^ octant ];
+      if ( child == NULL ) continue;
+      unsigned int cmask = rp.intersectBox( child->bbmin_, child->bbmax_, mask );
+      if ( cmask ) child->raycastPacketNode( rp, cmask, octant, mb );
+    }
+  };
+
+  // raycast() の再帰関数
+  void raycastNode( const Eigen::Vector3d& pos, const Eigen::Vector3d& dir,
+                    const Eigen::Vector3d& inv_dir, RayHit& hit, TriMailbox& mb ) {
+    if ( !tris_.empty() ) intersectRayFaces( pos, dir, hit, mb );
+
+    // 子ノードを入口のパラメータ順に並べる
+    double t_enter[8];
+    Octree* order[8];
+    int n = 0;
+    for ( int i = 0; i < 8; ++i ) {
+      if ( child_[i] == NULL ) continue;
+      double t_near = .0, t_far = hit.t;
+      if ( !child_[i]->rayBoxRange( pos, inv_dir, t_near, t_far ) ) continue;
+      int j = n++;
+      for ( ; (j > 0) && (t_enter[j-1] > t_near); --j ) {
+        t_enter[j] = t_enter[j-1];
+        order[j] = order[j-1];
+      }
+      t_enter[j] = t_near;
+      order[j] = child_[i];
+    }
+
+    for ( int i = 0; i < n; ++i ) {
+      // 既に見つかった交点の方が手前にある
+      if ( t_enter[i] > hit.t ) break;
+      order[i]->raycastNode( pos, dir, inv_dir, hit, mb );
+    }
+  };
+
+  // anyHit() の再帰関数
+  bool anyHitNode( const Eigen::Vector3d& pos, const Eigen::Vector3d& dir,
+                   const Eigen::Vector3d& inv_dir, double tmax, TriMailbox& mb ) {
+    for ( int i = 0; i < tris_.size(); ++i ) {
+      if ( mb.visited( tris_[i].id ) ) continue;
+      double t, u, v;
+      if ( intersectRayTri( tris_[i], pos, dir, &t, &u, &v )
+           && ( t >= .0 ) && ( t <= tmax ) ) return true;
+    }
+
+    for ( int i = 0; i < 8; ++i ) {
+      if ( child_[i] == NULL ) continue;
+      double t_near = .0, t_far = tmax;
+      if ( !child_[i]->rayBoxRange( pos, inv_dir, t_near, t_far ) ) continue;
+      if ( child_[i]->anyHitNode( pos, dir, inv_dir, tmax, mb ) ) return true;
+    }
+    return false;
+  };
+
+  // ftris_ にセット済みのレコードから木全体を作り直す (ルートで呼ぶ)
+  void buildTris( ThreadPool& pool ) {
+    clearChildren();
+    tris_.clear();
+    int n = (int) ftris_.size();
+    std::vector<int> idx( n );
+    for ( int i = 0; i < n; ++i ) idx[i] = i;
+    buildNode( ftris_, idx, cullEps(), pool );
+  };
+
+  // build() の再帰関数
+  // idx: このノードに入る三角形の番号 (振り分けた後に解放する)
+  void buildNode( const std::vector<OctreeTri>& tris, std::vector<int>& idx,
+                  double eps, ThreadPool& pool ) {
+    if ( level_ == MAX_LEVEL ) {
+      tris_.reserve( idx.size() );
+      for ( int i = 0; i < idx.size(); ++i ) tris_.push_back( tris[ idx[i] ] );
+      std::vector<int>().swap( idx );
+      return;
+    }
+
+    Eigen::Vector3d cbbmin[8], cbbmax[8];
+    for ( int i = 0; i < 8; ++i ) calcChildRange( i, cbbmin[i], cbbmax[i] );
+
+    // 各三角形が入る子のビットマスク
+    int n = (int) idx.size();
+    std::vector<unsigned char> cmask( n );
+    auto classify = [&]( int b, int e ) {
+      for ( int k = b; k < e; ++k ) cmask[k] = childMask( tris[ idx[k] ], cbbmin, cbbmax, eps );
+    };
+    if ( n > 4096 ) parallelForRange( pool, 0, n, 1024, classify );
+    else classify( 0, n );
+
+    // 子ごとの番号の配列に振り分ける
+    std::vector<int> cidx[8];
+    int count[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    for ( int k = 0; k < n; ++k )
+      for ( int i = 0; i < 8; ++i ) count[i] += ( cmask[k] >> i ) & 1;
+    for ( int i = 0; i < 8; ++i ) cidx[i].reserve( count[i] );
+    for ( int k = 0; k < n; ++k )
+      for ( int i = 0; i < 8; ++i ) if ( ( cmask[k] >> i ) & 1 ) cidx[i].push_back( idx[k] );
+    std::vector<int>().swap( idx );
+    std::vector<unsigned char>().swap( cmask );
+
+    // 子ノードの構築 (大きいものはタスクにする)
+    TaskGroup tg( pool );
+    for ( int i = 0; i < 8; ++i ) {
+      if ( cidx[i].empty() ) continue;
+      if ( child_[i] == NULL ) child_[i] = addChild( i );
+      Octree* child = child_[i];
+      std::vector<int>* ci = &cidx[i];
+      if ( ci->size() > 512 )
+        tg.run( [child, &tris, ci, eps, &pool]() { child->buildNode( tris, *ci, eps, pool ); } );
+      else
+        child->buildNode( tris, *ci, eps, pool );
+    }
+    tg.wait();
+  };
+
+  // AABB による枝刈りの余裕 (triBoxOverlap の float での丸め誤差を吸収する)
+  double cullEps() const {
+    return 1.0e-5 * std::max( bbmin_.cwiseAbs().maxCoeff(), bbmax_.cwiseAbs().maxCoeff() );
+  };
+
+  // 三角形が重なる子 (ボックス cbbmin[i], cbbmax[i]) のビットマスク
+  unsigned char childMask( const OctreeTri& tri, Eigen::Vector3d cbbmin[8], Eigen::Vector3d cbbmax[8],
+                           double eps ) {
+    double lo[3], hi[3];
+    triBound( tri, eps, lo, hi );
+    unsigned char m = 0;
+    for ( int i = 0; i < 8; ++i ) {
+      if ( isTriOverlapBox( tri, lo, hi, cbbmin[i], cbbmax[i] ) ) m |= (unsigned char) (1 << i);
+    }
+    return m;
+  };
+
+  // 三角形の AABB を eps だけ広げたもの
+  static void triBound( const OctreeTri& tri, double eps, double lo[3], double hi[3] ) {
+    for ( int j = 0; j < 3; ++j ) {
+      double a = tri.v0[j], b1 = a + tri.e1[j], b2 = a + tri.e2[j];
+      lo[j] = std::min( a, std::min( b1, b2 ) ) - eps;
+      hi[j] = std::max( a, std::max( b1, b2 ) ) + eps;
+    }
+  };
+
+  //
+  // 三角形がボックスと重なるかどうか (木の構築で子ノードに入れるかどうかの判定)
+  // lo, hi: triBound() で求めた三角形の AABB
+  // AABB が重ならない場合と，AABB がボックスに収まる場合は SAT を省く
+  //
+  bool isTriOverlapBox( const OctreeTri& tri, const double lo[3], const double hi[3],
+                        Eigen::Vector3d& bbmin, Eigen::Vector3d& bbmax ) {
+    if ( ( hi[0] < bbmin.x() ) || ( lo[0] > bbmax.x() ) ||
+         ( hi[1] < bbmin.y() ) || ( lo[1] > bbmax.y() ) ||
+         ( hi[2] < bbmin.z() ) || ( lo[2] > bbmax.z() ) ) return false;
+    if ( ( lo[0] >= bbmin.x() ) && ( hi[0] <= bbmax.x() ) &&
+         ( lo[1] >= bbmin.y() ) && ( hi[1] <= bbmax.y() ) &&
+         ( lo[2] >= bbmin.z() ) && ( hi[2] <= bbmax.z() ) ) return true;
+    return isFaceOveralapBox( tri, bbmin, bbmax );
+  };
+
+
+  //
+  // 深さ MAX_LEVEL のセルの境界の座標 grid[j][0..2^MAX_LEVEL] を求める
+  // (calcChildRange() で中点を取っていくのと同じ値になる)
+  //
+  void cellGrid( std::vector<double> grid[3] ) const {
+    const int n = 1 << MAX_LEVEL;
+    for ( int j = 0; j < 3; ++j ) {
+      grid[j].resize( n + 1 );
+      grid[j][0] = bbmin_[j];
+      grid[j][n] = bbmax_[j];
+      for ( int w = n; w > 1; w >>= 1 )
+        for ( int k = 0; k < n; k += w ) grid[j][ k + w / 2 ] = ( grid[j][k] + grid[j][ k + w ] ) / 2.0;
+    }
+  };
+
+  //
+  // 三角形 tri が重なる葉の番号を codes に (昇順に) 追加する
+  // - 葉の番号は，ルートから辿る子の番号を上位から 3 ビットずつ並べたもの
+  // - addFaceToOctree() で入る葉と同じになる (ノードが存在しない葉も求める)
+  // - 三角形の AABB が掛かる深さ MAX_LEVEL のセルの範囲を先に求めておき，
+  //   範囲外の子は座標を計算せずに飛ばす
+  //
+  void triLeafCodes( const OctreeTri& tri, std::vector<double> grid[3], double eps,
+                     std::vector<int>& codes ) {
+    double lo[3], hi[3];
+    triBound( tri, eps, lo, hi );
+    int c0[3], c1[3];
+    cellRange( lo, hi, grid, eps, c0, c1 );
+    triLeafCodes( tri, lo, hi, c0, c1, grid, 0, 0, 0, 0, 0, codes );
+  };
+
+  //
+  // 三角形 tri の AABB が掛かる深さ MAX_LEVEL のセルの範囲 [c0, c1] が，高々 1 つの軸に並ぶ 1 列の
+  // セルで，AABB を広げる幅 (0 から triLeafCodes() の 2 eps を超える 4 eps まで) によらなければ true
+  // - 三角形はつながっているので，列の両端のセルまで届き，ほかの軸では 1 つのセルに収まれば
+  //   列のすべてのセルに (eps より深く) 重なる．つまり重なる葉は範囲のセルそのものになる
+  // - 範囲はルートのボックスの端のセルに丸められるので，広げた AABB がボックスからはみ出す場合は false
+  //
+  static bool cellLine( const OctreeTri& tri, std::vector<double> grid[3], double eps, int c0[3], int c1[3] ) {
+    double lo[3], hi[3];
+    int d0[3], d1[3];
+    triBound( tri, .0, lo, hi );
+    cellRange( lo, hi, grid, .0, c0, c1 );
+    triBound( tri, 2.0 * eps, lo, hi );
+    cellRange( lo, hi, grid, 2.0 * eps, d0, d1 );
+    int n_axes = 0;
+    for ( int j = 0; j < 3; ++j ) {
+      if ( ( lo[j] - 2.0 * eps <= grid[j].front() ) || ( hi[j] + 2.0 * eps >= grid[j].back() ) ) return false;
+      if ( ( c0[j] != d0[j] ) || ( c1[j] != d1[j] ) ) return false;
+      if ( c1[j] > c0[j] ) ++n_axes;
+    }
+    return ( n_axes <= 1 );
+  };
+
+  // AABB [lo, hi] を eps だけ広げた範囲が掛かる深さ MAX_LEVEL のセルの範囲 [c0, c1]
+  static void cellRange( const double lo[3], const double hi[3], std::vector<double> grid[3], double eps,
+                         int c0[3], int c1[3] ) {
+    for ( int j = 0; j < 3; ++j ) {
+      c0[j] = cellIndex( grid[j], lo[j] - eps );
+      c1[j] = cellIndex( grid[j], hi[j] + eps );
+    }
+  };
+
+  //
+  // grid[c] <= x < grid[c+1] となるセル c (0 ... 2^MAX_LEVEL - 1 に丸める)
+  // 等間隔として求めてから，中点で求めた grid の値と比べて補正する
+  // (std::upper_bound( grid.begin() + 1, grid.end() - 1, x ) - grid.begin() - 1 と同じ)
+  //
+  static int cellIndex( const std::vector<double>& grid, double x ) {
+    const int n = 1 << MAX_LEVEL;
+    double g = ( x - grid[0] ) / ( grid[n] - grid[0] ) * n;
+    int c = ( g <= .0 ) ? 0 : ( ( g >= (double) ( n - 1 ) ) ? n - 1 : (int) g );
+    while ( ( c > 0 ) && ( grid[c] > x ) ) --c;
+    while ( ( c < n - 1 ) && ( grid[ c + 1 ] <= x ) ) ++c;
+    return c;
+  };
+
+  // triLeafCodes() の再帰関数
+  // (ax, ay, az): 深さ level のノードのセル座標
+  void triLeafCodes( const OctreeTri& tri, const double lo[3], const double hi[3],
+                     const int c0[3], const int c1[3], std::vector<double> grid[3],
+                     int level, int ax, int ay, int az, int code, std::vector<int>& codes ) {
+    if ( level == MAX_LEVEL ) {
+      codes.push_back( code );
+      return;
+    }
+    int sh = MAX_LEVEL - level - 1;
+    for ( int i = 0; i < 8; ++i ) {
+      int bx = 2 * ax + ( i & 1 ), by = 2 * ay + ( ( i >> 1 ) & 1 ), bz = 2 * az + ( ( i >> 2 ) & 1 );
+      if ( ( bx < ( c0[0] >> sh ) ) || ( bx > ( c1[0] >> sh ) ) ||
+           ( by < ( c0[1] >> sh ) ) || ( by > ( c1[1] >> sh ) ) ||
+           ( bz < ( c0[2] >> sh ) ) || ( bz > ( c1[2] >> sh ) ) ) continue;
+      Eigen::Vector3d cmin( grid[0][ bx << sh ], grid[1][ by << sh ], grid[2][ bz << sh ] );
+      Eigen::Vector3d cmax( grid[0][ ( bx + 1 ) << sh ], grid[1][ ( by + 1 ) << sh ], grid[2][ ( bz + 1 ) << sh ] );
+      if ( !isTriOverlapBox( tri, lo, hi, cmin, cmax ) ) continue;
+      triLeafCodes( tri, lo, hi, c0, c1, grid, level + 1, bx, by, bz, ( code << 3 ) | i, codes );
+    }
+  };
+
+  // 深さ MAX_LEVEL のノード (葉) とその番号を集める
+  void collectLeaves( int code, std::vector<Octree*>& leaves, std::vector<int>& codes ) {
+    if ( level_ == MAX_LEVEL ) {
+      leaves.push_back( this );
+      codes.push_back( code );
+      return;
+    }
+    for ( int i = 0; i < 8; ++i ) {
+      if ( child_[i] != NULL ) child_[i]->collectLeaves( ( code << 3 ) | i, leaves, codes );
+    }
+  };
+
+  // 番号 code の深さ level のノード (なければ作る)
+  Octree* leafNode( int code, int level ) {
+    Octree* node = this;
+    for ( int l = 1; l <= level; ++l ) {
+      int id = ( code >> ( 3 * ( level - l ) ) ) & 7;
+      if ( node->child_[id] == NULL ) node->addChild( id );
+      node = node->child_[id];
+    }
+    return node;
+  };
+
+  // 1 回の問い合わせの判定数をルートの統計に加える
+  void addStats( const TriMailbox& mb ) {
+    if ( !root_->stats_ ) return;
+    if ( mb.tested ) root_->n_tested_ += mb.tested;
+    if ( mb.skipped ) root_->n_skipped_ += mb.skipped;
+  };
+
+  // 面を面の表に登録し，三角形のレコード tri を作る (ルートで呼ぶ)
+  void registerFace( FaceL* fc, OctreeTri& tri ) {
+    tri.set( fc, (int) faces_.size() );
+    faces_.push_back( fc );
+    ftris_.push_back( tri );
+  };
+
   int level_;
   Eigen::Vector3d bbmin_, bbmax_;
+  Octree* root_;
   Octree* parent_;
   Octree* child_[8];
-  std::vector<FaceL*> flist_;
+
+  // 葉ノードの三角形のレコード
+  std::vector<OctreeTri> tris_;
+  // 三角形のレコードの id から面と，その時点のレコードへの表 (ルートのみ)
+  std::vector<FaceL*> faces_;
+  std::vector<OctreeTri> ftris_;
+
+  // 問い合わせの統計 (ルートのみ)
+  bool stats_;
+  std::atomic<long long> n_tested_;
+  std::atomic<long long> n_skipped_;
 };
 
 #endif // _OCTREE_HXX
@@ -0,0 +1,151 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: OctreeAO.hxx 2026/10/18 11:52:09 kanai Exp $
+//
+// Copyright (c) 2026 by Takashi Kanai. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef _OCTREEAO_HXX
+#define _OCTREEAO_HXX 1
+
+#include <vector>
+#include <random>
+#include <cmath>
+using namespace std;
+
+#include "myEigen.hxx"
+#include "MeshL.hxx"
+#include "MeshR.hxx"
+
+#include "Octree.hxx"
+#include "ThreadPool.hxx"
+
+//
+// Octree (または BVH) を使った頂点ごとのアンビエントオクルージョン (AO) の計算
+// - 各頂点から法線側の半球にコサイン分布のレイを n_rays 本飛ばし，
+//   遮られなかったレイの割合を AO 値 (1: 遮蔽なし, 0: 完全に遮蔽) とする
+// - レイはまとめて Accelerator::anyHitBatch() で判定する
+//
+class OctreeAO {
+
+public:
+
+  OctreeAO() : n_rays_(64), max_dist_(std::numeric_limits<double>::max()), offset_(1.0e-5) {};
+  ~OctreeAO() {};
+
+  void setNumRays( int n ) { n_rays_ = n; };
+  int numRays() const { return n_rays_; };
+  // レイの長さ (これより遠い面は遮蔽とみなさない)
+  void setMaxDistance( double d ) { max_dist_ = d; };
+  double maxDistance() const { return max_dist_; };
+  // 自己交差を避けるための始点のずらし量 (メッシュの対角線長に対する比)
+  void setOffset( double o ) { offset_ = o; };
+
+  //
+  // 頂点ごとの AO 値を ao に格納する (ao[vt->id()])
+  //
+  void calcVertexAO( Accelerator& acc, MeshL& mesh, std::vector<double>& ao,
+                     ThreadPool& pool = ThreadPool::instance() ) {
+    mesh.resetVertexID();
+    int n_vt = mesh.vertices_size();
+
+    std::vector<VertexL*> vts;
+    vts.reserve( n_vt );
+    for ( auto vt : mesh.vertices() ) vts.push_back( vt );
+
+    // 面積で重み付けした頂点法線
+    std::vector<Eigen::Vector3d> nrm( n_vt, Eigen::Vector3d::Zero() );
+    for ( auto fc : mesh.faces() ) {
+      Eigen::Vector3d n = fc->normal() * fc->area();
+      for ( auto he : fc->halfedges() ) nrm[ he->vertex()->id() ] += n;
+    }
+
+    Eigen::Vector3d bbmin, bbmax;
+    mesh.computeBB( bbmin, bbmax );
+    double eps = offset_ * (bbmax - bbmin).norm();
+
+    ao.assign( n_vt, 1.0 );
+
+    // 頂点をまとめて処理する (レイ配列の大きさを抑える)
+    const int chunk = 4096;
+    std::vector<Eigen::Vector3d> origins, dirs;
+    std::vector<char> occluded;
+    for ( int b = 0; b < n_vt; b += chunk ) {
+      int e = std::min( b + chunk, n_vt );
+      origins.resize( (e - b) * n_rays_ );
+      dirs.resize( (e - b) * n_rays_ );
+
+      parallelFor( pool, b, e, 64, [&]( int i ) {
+          Eigen::Vector3d n = nrm[i];
+          if ( n.norm() > .0 ) n.normalize(); else n = Eigen::Vector3d::UnitZ();
+          Eigen::Vector3d t1, t2;
+          tangentFrame( n, t1, t2 );
+
+          // 頂点ごとに決まった乱数列を使う (スレッド数によらず同じ結果になる)
+          std::mt19937 gen( (unsigned int) i );
+          std::uniform_real_distribution<double> uni( 0.0, 1.0 );
+
+          Eigen::Vector3d o = vts[i]->point() + eps * n;
+          for ( int k = 0; k < n_rays_; ++k ) {
+            double r1 = uni( gen ), r2 = uni( gen );
+            double phi = 2.0 * M_PI * r1;
+            double s = std::sqrt( r2 );
+            int j = (i - b) * n_rays_ + k;
+            origins[j] = o;
+            dirs[j] = s * std::cos( phi ) * t1 + s * std::sin( phi ) * t2 + std::sqrt( 1.0 - r2 ) * n;
+          }
+        } );
+
+      acc.anyHitBatch( origins, dirs, occluded, max_dist_, pool );
+
+      for ( int i = b; i < e; ++i ) {
+        int count = 0;
+        for ( int k = 0; k < n_rays_; ++k ) count += occluded[ (i - b) * n_rays_ + k ];
+        ao[i] = 1.0 - (double) count / (double) n_rays_;
+      }
+    }
+  };
+
+  //
+  // MeshL の形状と頂点の AO 値を表示用の MeshR にセットする
+  // 色は MeshR::setColor() でグレースケールとして書き込む
+  //
+  void setMeshR( MeshL& mesh, std::vector<double>& ao, MeshR& meshr ) {
+    meshr.clear();
+    mesh.resetVertexID();
+
+    meshr.reservePoints( mesh.vertices_size() );
+    for ( auto vt : mesh.vertices() ) {
+      Eigen::Vector3d& p = vt->point();
+      meshr.setPoint( nXYZ * vt->id(), (float) p.x(), (float) p.y(), (float) p.z() );
+    }
+
+    meshr.reserveIndices( mesh.faces_size() );
+    int i = 0;
+    for ( auto fc : mesh.faces() ) {
+      for ( auto he : fc->halfedges() ) meshr.setIndex( i++, he->vertex()->id() );
+    }
+
+    meshr.reserveColors( mesh.vertices_size() );
+    for ( int j = 0; j < mesh.vertices_size(); ++j ) {
+      unsigned char c = (unsigned char) ( 255.0 * std::max( 0.0, std::min( 1.0, ao[j] ) ) );
+      meshr.setColor( nXYZ * j, c, c, c );
+    }
+  };
+
+private:
+
+  // 法線 n に直交する単位ベクトル t1, t2
+  void tangentFrame( const Eigen::Vector3d& n, Eigen::Vector3d& t1, Eigen::Vector3d& t2 ) {
+    Eigen::Vector3d a = ( std::fabs( n.x() ) < 0.9 ) ? Eigen::Vector3d::UnitX() : Eigen::Vector3d::UnitY();
+    t1 = n.cross( a ).normalized();
+    t2 = n.cross( t1 );
+  };
+
+  int n_rays_;
+  double max_dist_;
+  double offset_;
+};
+
+#endif // _OCTREEAO_HXX
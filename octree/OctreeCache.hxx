@@ -0,0 +1,499 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: OctreeCache.hxx 2026/10/18 15:18:26 kanai Exp $
+//
+// Copyright (c) 2026 by Takashi Kanai. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef _OCTREECACHE_HXX
+#define _OCTREECACHE_HXX 1
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <list>
+#include <limits>
+#include <queue>
+#include <type_traits>
+using namespace std;
+
+#include "myEigen.hxx"
+#include "FaceL.hxx"
+#include "VMProc.hxx"
+#include "MMapFile.hxx"
+
+#include "raytri.h"
+
+#include "Octree.hxx"
+#include "OctreeTri.hxx"
+#include "RayHit.hxx"
+#include "Accelerator.hxx"
+
+//
+// キャッシュファイルのヘッダ
+// ファイルの構成: ヘッダ，ノードの配列，三角形のレコードの配列 (8 バイト境界に揃える)
+//
+struct OctreeCacheHeader {
+  char magic[8];            // "OCTCACHE"
+  uint32_t version;
+  uint32_t header_size;     // sizeof(OctreeCacheHeader)
+  uint32_t node_size;       // sizeof(OctreeCacheNode)
+  uint32_t tri_size;        // sizeof(OctreeTri)
+  uint64_t mesh_hash;       // OctreeCache::meshHash()
+  int32_t n_faces;
+  int32_t n_nodes;
+  int32_t n_tris;
+  int32_t max_level;
+  double bbmin[3], bbmax[3];
+  uint64_t nodes_offset;
+  uint64_t tris_offset;
+  uint64_t file_size;
+};
+
+//
+// 線形化したノード
+// - 子は child[i] (ノード配列の番号．なければ -1)．i の意味は Octree と同じ
+// - このノードの三角形はレコード配列の tri_begin から tri_count 個
+//
+struct OctreeCacheNode {
+  double bbmin[3], bbmax[3];
+  int32_t child[8];
+  int32_t tri_begin;
+  int32_t tri_count;
+};
+
+//
+// 構築済みの Octree をファイルに保存し，次回以降はメモリにマップしてそのまま問い合わせる
+// - ノードは幅優先の順に配列に並べ，子はポインタの代わりに配列の番号で持つ
+// - ファイルにはメッシュのハッシュ値を記録し，読み込み時にメッシュと一致しなければ使わない
+// - 問い合わせはマップした領域を直接辿るので，読み込み時のデシリアライズはない
+// - 面 (FaceL*) はファイルに書けないので，三角形のレコードの id から faces[id] で引く
+//   (faces は保存時と同じ順でなければならない．ハッシュはこの順も含めて計算する)
+//
+class OctreeCache : public Accelerator {
+
+public:
+
+  enum { VERSION = 1 };
+
+  OctreeCache() : header_(NULL), nodes_(NULL), tris_(NULL) {};
+  ~OctreeCache() {};
+
+  const char* name() const { return "OctreeCache"; };
+
+  bool isLoaded() const { return ( header_ != NULL ) ? true : false; };
+  int nodes_size() const { return isLoaded() ? header_->n_nodes : 0; };
+  const OctreeCacheNode& node( int i ) const { return nodes_[i]; };
+  int tris_size() const { return isLoaded() ? header_->n_tris : 0; };
+  const OctreeTri& tri( int i ) const { return tris_[i]; };
+  FaceL* face( int id ) const { return faces_[id]; };
+
+  //
+  // 面の並びと頂点座標から 64 bit のハッシュ値 (FNV-1a) を計算する
+  //
+  static uint64_t meshHash( const std::vector<FaceL*>& faces ) {
+    uint64_t h = 14695981039346656037ULL;
+    int n = (int) faces.size();
+    hashBytes( h, &n, sizeof(int) );
+    for ( auto fc : faces ) {
+      for ( auto he : fc->halfedges() ) {
+        Eigen::Vector3d& p = he->vertex()->point();
+        double xyz[3] = { p.x(), p.y(), p.z() };
+        hashBytes( h, xyz, sizeof(xyz) );
+      }
+      // 面の区切り
+      hashBytes( h, "|", 1 );
+    }
+    return h;
+  };
+
+  //
+  // Octree を線形化してファイルと同じ形式のバイト列 buf にする
+  //
+  static void serialize( Octree& octree, uint64_t mesh_hash, std::vector<char>& buf ) {
+    static_assert( std::is_trivially_copyable<OctreeTri>::value, "OctreeTri must be trivially copyable" );
+
+    // 幅優先の順にノードを並べる
+    std::vector<Octree*> order;
+    order.push_back( &octree );
+    int n_tris = 0;
+    for ( int i = 0; i < order.size(); ++i ) {
+      n_tris += order[i]->tris_size();
+      for ( int j = 0; j < 8; ++j )
+        if ( order[i]->child( j ) != NULL ) order.push_back( order[i]->child( j ) );
+    }
+
+    OctreeCacheHeader hd;
+    memset( &hd, 0, sizeof(OctreeCacheHeader) );
+    memcpy( hd.magic, "OCTCACHE", 8 );
+    hd.version = VERSION;
+    hd.header_size = sizeof(OctreeCacheHeader);
+    hd.node_size = sizeof(OctreeCacheNode);
+    hd.tri_size = sizeof(OctreeTri);
+    hd.mesh_hash = mesh_hash;
+    hd.n_faces = octree.faces_size();
+    hd.n_nodes = (int32_t) order.size();
+    hd.n_tris = n_tris;
+    hd.max_level = MAX_LEVEL;
+    for ( int j = 0; j < 3; ++j ) {
+      hd.bbmin[j] = octree.getBBmin()[j];
+      hd.bbmax[j] = octree.getBBmax()[j];
+    }
+    hd.nodes_offset = align8( sizeof(OctreeCacheHeader) );
+    hd.tris_offset = align8( hd.nodes_offset + order.size() * sizeof(OctreeCacheNode) );
+    hd.file_size = hd.tris_offset + (uint64_t) n_tris * sizeof(OctreeTri);
+
+    // 境界合わせの隙間も 0 で埋まる
+    buf.assign( (size_t) hd.file_size, 0 );
+    memcpy( buf.data(), &hd, sizeof(OctreeCacheHeader) );
+    OctreeCacheNode* nodes = (OctreeCacheNode*) ( buf.data() + hd.nodes_offset );
+    OctreeTri* tris = (OctreeTri*) ( buf.data() + hd.tris_offset );
+
+    int next = 1, n = 0;
+    for ( int i = 0; i < order.size(); ++i ) {
+      Octree* o = order[i];
+      OctreeCacheNode& nd = nodes[i];
+      for ( int j = 0; j < 3; ++j ) {
+        nd.bbmin[j] = o->getBBmin()[j];
+        nd.bbmax[j] = o->getBBmax()[j];
+      }
+      // 子は同じ順で order に入っている
+      for ( int j = 0; j < 8; ++j ) nd.child[j] = ( o->child( j ) != NULL ) ? next++ : -1;
+      nd.tri_begin = n;
+      nd.tri_count = o->tris_size();
+      for ( int k = 0; k < o->tris_size(); ++k ) tris[n++] = o->tri( k );
+    }
+  };
+
+  //
+  // Octree を線形化してファイルに保存する
+  //
+  static bool save( const char* filename, Octree& octree, uint64_t mesh_hash ) {
+    std::vector<char> buf;
+    serialize( octree, mesh_hash, buf );
+    return writeFile( filename, buf );
+  };
+
+  //
+  // キャッシュファイルをマップする
+  // ファイルが壊れている，版が違う，またはメッシュのハッシュ値が違う場合は false
+  //
+  bool load( const char* filename, const std::vector<FaceL*>& faces, uint64_t mesh_hash ) {
+    unload();
+    if ( !file_.open( filename ) ) return false;
+    if ( attach( file_.data(), file_.size(), faces, mesh_hash ) ) return true;
+    file_.close();
+    return false;
+  };
+
+  void unload() {
+    file_.close();
+    std::vector<char>().swap( buf_ );
+    header_ = NULL;
+    nodes_ = NULL;
+    tris_ = NULL;
+    faces_.clear();
+  };
+
+  //
+  // キャッシュがあれば読み込み，なければ (またはメッシュが変わっていれば)
+  // Octree を構築して保存してから読み込む
+  // - キャッシュをそのまま使えた場合に true を返す
+  // - ファイルに書き込めない場合は，線形化したバイト列をメモリに持って使う
+  //
+  bool openOrBuild( const char* filename, const std::vector<FaceL*>& faces,
+                    const Eigen::Vector3d& bbmin, const Eigen::Vector3d& bbmax,
+                    ThreadPool& pool = ThreadPool::instance() ) {
+    uint64_t h = meshHash( faces );
+    if ( load( filename, faces, h ) ) return true;
+
+    std::vector<char> buf;
+    {
+      Octree octree;
+      Eigen::Vector3d bmin( bbmin ), bmax( bbmax );
+      octree.setBB( bmin, bmax );
+      octree.build( faces, pool );
+      serialize( octree, h, buf );
+    }
+    if ( writeFile( filename, buf ) && load( filename, faces, h ) ) return false;
+
+    std::cerr << "Warning: cannot write octree cache " << filename << std::endl;
+    unload();
+    buf_.swap( buf );
+    attach( buf_.data(), buf_.size(), faces, h );
+    return false;
+  };
+
+  bool openOrBuild( const char* filename, std::list<FaceL*>& faces,
+                    const Eigen::Vector3d& bbmin, const Eigen::Vector3d& bbmax,
+                    ThreadPool& pool = ThreadPool::instance() ) {
+    std::vector<FaceL*> fv( faces.begin(), faces.end() );
+    return openOrBuild( filename, fv, bbmin, bbmax, pool );
+  };
+
+  //
+  // レイ origin + t * dir (0 <= t <= tmax) とメッシュとの最近交点
+  // - Octree::raycast() と同じく，子ノードをレイの入口の順に辿る
+  //
+  RayHit raycast( const Eigen::Vector3d& origin, const Eigen::Vector3d& dir,
+                  double tmax = std::numeric_limits<double>::max() ) {
+    RayHit hit;
+    hit.t = tmax;
+    if ( !isLoaded() ) return RayHit();
+
+    double orig[3] = { origin.x(), origin.y(), origin.z() };
+    double ddir[3] = { dir.x(), dir.y(), dir.z() };
+    double inv[3] = { 1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z() };
+
+    TriMailbox mb;
+    int stack[STACK_SIZE];
+    double stack_t[STACK_SIZE];
+    int sp = 0;
+    double t_near;
+    if ( !rayBox( nodes_[0], orig, inv, hit.t, t_near ) ) return RayHit();
+    stack[sp] = 0;
+    stack_t[sp++] = t_near;
+
+    while ( sp > 0 ) {
+      --sp;
+      // 既に見つかった交点の方が手前にある
+      if ( stack_t[sp] > hit.t ) continue;
+      const OctreeCacheNode& nd = nodes_[ stack[sp] ];
+
+      for ( int k = nd.tri_begin; k < nd.tri_begin + nd.tri_count; ++k ) {
+        const OctreeTri& tri = tris_[k];
+        if ( mb.visited( tri.id ) ) continue;
+        double t, u, v;
+        if ( intersect_triangle2_edge( orig, ddir, tri.v0, tri.e1, tri.e2, &t, &u, &v )
+             && ( t >= .0 ) && ( t < hit.t ) ) {
+          hit.face = faces_[ tri.id ];
+          hit.t = t;
+          hit.u = u;
+          hit.v = v;
+        }
+      }
+
+      // 子ノードを入口の遠い順に積む (近いものから取り出される)
+      int order[8];
+      double t_enter[8];
+      int n = 0;
+      for ( int i = 0; i < 8; ++i ) {
+        int c = nd.child[i];
+        if ( ( c < 0 ) || !rayBox( nodes_[c], orig, inv, hit.t, t_near ) ) continue;
+        int j = n++;
+        for ( ; ( j > 0 ) && ( t_enter[j-1] < t_near ); --j ) {
+          t_enter[j] = t_enter[j-1];
+          order[j] = order[j-1];
+        }
+        t_enter[j] = t_near;
+        order[j] = c;
+      }
+      for ( int i = 0; ( i < n ) && ( sp < STACK_SIZE ); ++i ) {
+        stack[sp] = order[i];
+        stack_t[sp++] = t_enter[i];
+      }
+    }
+
+    if ( !hit.isHit() ) hit.t = std::numeric_limits<double>::max();
+    return hit;
+  };
+
+  //
+  // シャドウレイ用: [0, tmax] の範囲にひとつでも交点があれば true を返す
+  //
+  bool anyHit( const Eigen::Vector3d& origin, const Eigen::Vector3d& dir,
+               double tmax = std::numeric_limits<double>::max() ) {
+    if ( !isLoaded() ) return false;
+
+    double orig[3] = { origin.x(), origin.y(), origin.z() };
+    double ddir[3] = { dir.x(), dir.y(), dir.z() };
+    double inv[3] = { 1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z() };
+
+    TriMailbox mb;
+    int stack[STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = 0;
+    while ( sp > 0 ) {
+      const OctreeCacheNode& nd = nodes_[ stack[--sp] ];
+      double t_near;
+      if ( !rayBox( nd, orig, inv, tmax, t_near ) ) continue;
+
+      for ( int k = nd.tri_begin; k < nd.tri_begin + nd.tri_count; ++k ) {
+        const OctreeTri& tri = tris_[k];
+        if ( mb.visited( tri.id ) ) continue;
+        double t, u, v;
+        if ( intersect_triangle2_edge( orig, ddir, tri.v0, tri.e1, tri.e2, &t, &u, &v )
+             && ( t >= .0 ) && ( t <= tmax ) ) return true;
+      }
+      for ( int i = 0; ( i < 8 ) && ( sp < STACK_SIZE ); ++i ) if ( nd.child[i] >= 0 ) stack[sp++] = nd.child[i];
+    }
+    return false;
+  };
+
+  //
+  // 点 p に最も近いメッシュ上の点を求める (距離が max_dist 以上のものは探さない)
+  // - Octree::closestPoint() と同じく，ボックスまでの距離の近い順に辿る
+  //
+  ClosestHit closestPoint( const Eigen::Vector3d& p,
+                           double max_dist = std::numeric_limits<double>::max() ) {
+    ClosestHit hit;
+    hit.distance = max_dist;
+    if ( !isLoaded() ) return ClosestHit();
+
+    TriMailbox mb;
+    typedef std::pair<double, int> QNode;
+    std::priority_queue<QNode, std::vector<QNode>, std::greater<QNode> > queue;
+    queue.push( QNode( boxDistance2( nodes_[0], p ), 0 ) );
+
+    while ( !queue.empty() ) {
+      QNode top = queue.top();
+      queue.pop();
+      if ( top.first >= hit.distance * hit.distance ) break;
+
+      const OctreeCacheNode& nd = nodes_[ top.second ];
+      for ( int k = nd.tri_begin; k < nd.tri_begin + nd.tri_count; ++k ) {
+        const OctreeTri& tri = tris_[k];
+        if ( mb.visited( tri.id ) ) continue;
+        Eigen::Vector3d q;
+        double bc[3];
+        double d = triClosestPoint( p, tri.point(0), tri.point(1), tri.point(2), q, bc );
+        if ( d < hit.distance ) {
+          hit.face = faces_[ tri.id ];
+          hit.point = q;
+          hit.distance = d;
+          hit.bc[0] = bc[0]; hit.bc[1] = bc[1]; hit.bc[2] = bc[2];
+        }
+      }
+
+      for ( int i = 0; i < 8; ++i ) {
+        int c = nd.child[i];
+        if ( c < 0 ) continue;
+        double d2 = boxDistance2( nodes_[c], p );
+        if ( d2 < hit.distance * hit.distance ) queue.push( QNode( d2, c ) );
+      }
+    }
+
+    if ( !hit.isHit() ) hit.distance = std::numeric_limits<double>::max();
+    return hit;
+  };
+
+private:
+
+  //
+  // 先頭 p から size バイトのキャッシュ (マップした領域またはメモリ上のバイト列) を検査して使う
+  //
+  bool attach( const char* p, size_t size, const std::vector<FaceL*>& faces, uint64_t mesh_hash ) {
+    const OctreeCacheHeader* hd = (const OctreeCacheHeader*) p;
+    if ( ( size < sizeof(OctreeCacheHeader) )
+         || ( memcmp( hd->magic, "OCTCACHE", 8 ) != 0 )
+         || ( hd->version != VERSION )
+         || ( hd->header_size != sizeof(OctreeCacheHeader) )
+         || ( hd->node_size != sizeof(OctreeCacheNode) )
+         || ( hd->tri_size != sizeof(OctreeTri) )
+         || ( hd->mesh_hash != mesh_hash )
+         || ( hd->max_level != MAX_LEVEL )
+         || ( hd->n_faces != (int32_t) faces.size() )
+         || ( hd->file_size != size )
+         || ( hd->n_nodes < 1 ) || ( hd->n_tris < 0 )
+         || ( hd->nodes_offset + (uint64_t) hd->n_nodes * sizeof(OctreeCacheNode) > hd->tris_offset )
+         || ( hd->tris_offset + (uint64_t) hd->n_tris * sizeof(OctreeTri) > size ) ) {
+      return false;
+    }
+
+    // 子の番号，三角形の範囲と面の番号が配列内にあるか (読むだけで，変換はしない)
+    // 各ノードの親はひとつで，深さ (親の深さ + 1) は max_level 以下か
+    // (走査のスタック STACK_SIZE は深さ MAX_LEVEL までの木を前提にしている)
+    const OctreeCacheNode* nodes = (const OctreeCacheNode*) ( p + hd->nodes_offset );
+    const OctreeTri* tris = (const OctreeTri*) ( p + hd->tris_offset );
+    std::vector<int> depth( hd->n_nodes, -1 );
+    depth[0] = 0;
+    bool ok = true;
+    for ( int i = 0; ok && ( i < hd->n_nodes ); ++i ) {
+      const OctreeCacheNode& nd = nodes[i];
+      // 子の番号は親より大きいので，親の深さは先に決まっている
+      if ( depth[i] < 0 ) ok = false;
+      for ( int j = 0; ok && ( j < 8 ); ++j ) {
+        int c = nd.child[j];
+        if ( c < 0 ) continue;
+        if ( ( c >= hd->n_nodes ) || ( c <= i ) || ( depth[c] >= 0 ) || ( depth[i] + 1 > hd->max_level ) ) ok = false;
+        else depth[c] = depth[i] + 1;
+      }
+      if ( ( nd.tri_begin < 0 ) || ( nd.tri_count < 0 ) || ( nd.tri_begin + nd.tri_count > hd->n_tris ) ) ok = false;
+      for ( int k = nd.tri_begin; ok && ( k < nd.tri_begin + nd.tri_count ); ++k )
+        if ( ( tris[k].id < 0 ) || ( tris[k].id >= hd->n_faces ) ) ok = false;
+    }
+    if ( !ok ) return false;
+
+    header_ = hd;
+    nodes_ = nodes;
+    tris_ = tris;
+    faces_ = faces;
+    return true;
+  };
+
+  // 深さ MAX_LEVEL の木で，各ノードの子を最大 8 個積む
+  // (attach() で深さを検査しているので足りるが，積むときにも念のため上限を確かめる)
+  enum { STACK_SIZE = 8 * ( MAX_LEVEL + 1 ) };
+
+  static void hashBytes( uint64_t& h, const void* data, size_t n ) {
+    const unsigned char* c = (const unsigned char*) data;
+    for ( size_t i = 0; i < n; ++i ) {
+      h ^= c[i];
+      h *= 1099511628211ULL;
+    }
+  };
+
+  static uint64_t align8( uint64_t n ) { return ( n + 7 ) & ~(uint64_t) 7; };
+
+  // 書き込み途中のファイルを読まないように，一時ファイルに書いてから置き換える
+  static bool writeFile( const char* filename, const std::vector<char>& buf ) {
+    std::string tmp = std::string( filename ) + ".tmp";
+    FILE* fp = fopen( tmp.c_str(), "wb" );
+    if ( fp == NULL ) return false;
+    bool ok = ( fwrite( buf.data(), 1, buf.size(), fp ) == buf.size() );
+    ok = ( fclose( fp ) == 0 ) && ok;
+    if ( ok ) {
+      remove( filename );
+      ok = ( rename( tmp.c_str(), filename ) == 0 );
+    }
+    if ( !ok ) remove( tmp.c_str() );
+    return ok;
+  };
+
+  // レイとノードのボックスの交差判定 (スラブ法)．[0, tmax] と重なれば入口を t_near に返す
+  static bool rayBox( const OctreeCacheNode& nd, const double orig[3], const double inv[3],
+                      double tmax, double& t_near ) {
+    double t0 = .0, t1 = tmax;
+    for ( int j = 0; j < 3; ++j ) {
+      double ta = ( nd.bbmin[j] - orig[j] ) * inv[j];
+      double tb = ( nd.bbmax[j] - orig[j] ) * inv[j];
+      t0 = std::max( t0, std::min( ta, tb ) );
+      t1 = std::min( t1, std::max( ta, tb ) );
+    }
+    t_near = t0;
+    return ( t0 <= t1 ) ? true : false;
+  };
+
+  // 点 p からノードのボックスまでの距離の 2 乗
+  static double boxDistance2( const OctreeCacheNode& nd, const Eigen::Vector3d& p ) {
+    double d2 = .0;
+    for ( int j = 0; j < 3; ++j ) {
+      if ( p[j] < nd.bbmin[j] ) d2 += ( nd.bbmin[j] - p[j] ) * ( nd.bbmin[j] - p[j] );
+      else if ( p[j] > nd.bbmax[j] ) d2 += ( p[j] - nd.bbmax[j] ) * ( p[j] - nd.bbmax[j] );
+    }
+    return d2;
+  };
+
+  MMapFile file_;
+  std::vector<char> buf_;   // ファイルに書けなかったときのバイト列
+  const OctreeCacheHeader* header_;
+  const OctreeCacheNode* nodes_;
+  const OctreeTri* tris_;
+  std::vector<FaceL*> faces_;
+};
+
+#endif // _OCTREECACHE_HXX
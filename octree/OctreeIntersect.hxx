@@ -0,0 +1,224 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: OctreeIntersect.hxx 2026/10/18 17:24:08 kanai Exp $
+//
+// Copyright (c) 2026 by Takashi Kanai. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef _OCTREEINTERSECT_HXX
+#define _OCTREEINTERSECT_HXX 1
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+using namespace std;
+
+#include "myEigen.hxx"
+#include "FaceL.hxx"
+
+#include "Octree.hxx"
+#include "ThreadPool.hxx"
+#include "tritri.h"
+
+//
+// 2 つの Octree (または Octree とそれ自身) を同時に辿る三角形どうしの交差判定
+// - ボックスが重ならないノードの組は枝刈りし，重なる葉の組の三角形だけを
+//   NoDivTriTriIsect() (Möller) で判定する
+// - 交点はどちらの三角形も入っている葉の中にあるので，葉のボックスで枝刈りしても
+//   交差を見落とすことはない
+// - 深さ TASK_LEVEL までのノードの組をタスクとし，スレッドプールで並列に処理する
+// - 結果は Octree の三角形のレコードの id (Octree::face(id) で面を引く) の組で，
+//   昇順に並べ，重複は除く
+//
+class OctreeIntersect {
+
+public:
+
+  enum { TASK_LEVEL = 2 };
+
+  OctreeIntersect() : self_(false), n_box_pairs_(0), n_tri_tests_(0) {};
+  ~OctreeIntersect() {};
+
+  //
+  // 自己交差: 頂点を共有する (隣接する) 面の組は除く
+  // 結果の組 (a, b) は a < b
+  //
+  void selfIntersect( Octree& octree, std::vector<std::pair<int, int> >& pairs,
+                      ThreadPool& pool = ThreadPool::instance() ) {
+    setVertices( octree, verts_a_ );
+    self_ = true;
+    run( octree, octree, pairs, pool );
+  };
+
+  //
+  // 2 つのメッシュの交差: 結果の組 (a, b) の a は octree_a, b は octree_b の id
+  //
+  void intersect( Octree& octree_a, Octree& octree_b, std::vector<std::pair<int, int> >& pairs,
+                  ThreadPool& pool = ThreadPool::instance() ) {
+    verts_a_.clear();
+    self_ = false;
+    run( octree_a, octree_b, pairs, pool );
+  };
+
+  // 直前の判定の統計: 調べたノードの組の数と三角形の組の判定の数
+  long long boxPairs() const { return n_box_pairs_; };
+  long long triTests() const { return n_tri_tests_; };
+
+private:
+
+  // 並列に処理するノードの組と，その結果
+  struct Task {
+    Octree* a;
+    Octree* b;
+    std::vector<std::pair<int, int> > pairs;
+    long long n_box_pairs;
+    long long n_tri_tests;
+
+    Task( Octree* na, Octree* nb ) : a(na), b(nb), n_box_pairs(0), n_tri_tests(0) {};
+  };
+
+  // 面の頂点のポインタ (隣接判定用) を id の順に並べる
+  static void setVertices( Octree& octree, std::vector<VertexL*>& verts ) {
+    verts.assign( 3 * octree.faces_size(), (VertexL*) NULL );
+    for ( int f = 0; f < octree.faces_size(); ++f ) {
+      auto he = octree.face( f )->halfedges().begin();
+      for ( int m = 0; m < 3; ++m, ++he ) verts[ 3 * f + m ] = (*he)->vertex();
+    }
+  };
+
+  void run( Octree& octree_a, Octree& octree_b, std::vector<std::pair<int, int> >& pairs,
+            ThreadPool& pool ) {
+    pairs.clear();
+    n_box_pairs_ = n_tri_tests_ = 0;
+
+    tasks_.clear();
+    collectTasks( &octree_a, &octree_b, self_ );
+    parallelFor( pool, 0, (int) tasks_.size(), 1, [&]( int t ) {
+        Task& task = tasks_[t];
+        traverse( task.a, task.b, self_ && ( task.a == task.b ), task );
+        std::sort( task.pairs.begin(), task.pairs.end() );
+        task.pairs.erase( std::unique( task.pairs.begin(), task.pairs.end() ), task.pairs.end() );
+      } );
+
+    for ( auto& task : tasks_ ) {
+      pairs.insert( pairs.end(), task.pairs.begin(), task.pairs.end() );
+      n_box_pairs_ += task.n_box_pairs;
+      n_tri_tests_ += task.n_tri_tests;
+    }
+    tasks_.clear();
+
+    // 同じ三角形の組は複数の葉の組で見つかりうる
+    std::sort( pairs.begin(), pairs.end() );
+    pairs.erase( std::unique( pairs.begin(), pairs.end() ), pairs.end() );
+  };
+
+  // ボックスが重なるかどうか (境界で接する場合も重なるとみなす)
+  static bool isBoxOverlap( Octree* a, Octree* b ) {
+    for ( int j = 0; j < 3; ++j )
+      if ( ( a->getBBmax()[j] < b->getBBmin()[j] ) || ( b->getBBmax()[j] < a->getBBmin()[j] ) )
+        return false;
+    return true;
+  };
+
+  // 深さ TASK_LEVEL までのノードの組を tasks_ に集める
+  void collectTasks( Octree* a, Octree* b, bool same ) {
+    if ( !same && !isBoxOverlap( a, b ) ) return;
+    if ( ( a->level() >= TASK_LEVEL ) || ( a->level() == MAX_LEVEL ) || ( b->level() == MAX_LEVEL ) ) {
+      tasks_.push_back( Task( a, b ) );
+      return;
+    }
+    for ( int i = 0; i < 8; ++i ) {
+      if ( a->child( i ) == NULL ) continue;
+      // 自分自身との組は (i, j) と (j, i) を重複して辿らないよう j >= i に限る
+      for ( int j = same ? i : 0; j < 8; ++j ) {
+        if ( b->child( j ) == NULL ) continue;
+        collectTasks( a->child( i ), b->child( j ), same && ( i == j ) );
+      }
+    }
+  };
+
+  //
+  // ノードの組 (a, b) を同時に辿る (same: a と b が同じノード)
+  // 葉でない方のノードを子に分ける
+  //
+  void traverse( Octree* a, Octree* b, bool same, Task& task ) {
+    ++task.n_box_pairs;
+    if ( !same && !isBoxOverlap( a, b ) ) return;
+
+    bool leaf_a = ( a->level() == MAX_LEVEL ), leaf_b = ( b->level() == MAX_LEVEL );
+    if ( leaf_a && leaf_b ) {
+      testLeaves( a, b, same, task );
+      return;
+    }
+
+    if ( same ) {
+      for ( int i = 0; i < 8; ++i ) {
+        if ( a->child( i ) == NULL ) continue;
+        for ( int j = i; j < 8; ++j ) {
+          if ( a->child( j ) == NULL ) continue;
+          traverse( a->child( i ), a->child( j ), i == j, task );
+        }
+      }
+    } else if ( !leaf_a && ( leaf_b || ( a->level() <= b->level() ) ) ) {
+      for ( int i = 0; i < 8; ++i )
+        if ( a->child( i ) != NULL ) traverse( a->child( i ), b, false, task );
+    } else {
+      for ( int j = 0; j < 8; ++j )
+        if ( b->child( j ) != NULL ) traverse( a, b->child( j ), false, task );
+    }
+  };
+
+  // 葉どうしの三角形の組を判定する
+  void testLeaves( Octree* a, Octree* b, bool same, Task& task ) {
+    for ( int i = 0; i < a->tris_size(); ++i ) {
+      const OctreeTri& ta = a->tri( i );
+      for ( int j = same ? i + 1 : 0; j < b->tris_size(); ++j ) {
+        const OctreeTri& tb = b->tri( j );
+        if ( self_ && ( ( ta.id == tb.id ) || isAdjacent( ta.id, tb.id ) ) ) continue;
+        if ( !isTriBoxOverlap( ta, tb ) ) continue;
+        ++task.n_tri_tests;
+        if ( isTriTriIntersect( ta, tb ) ) {
+          if ( self_ && ( ta.id > tb.id ) ) task.pairs.push_back( std::make_pair( tb.id, ta.id ) );
+          else task.pairs.push_back( std::make_pair( ta.id, tb.id ) );
+        }
+      }
+    }
+  };
+
+  // 面 fa と fb が頂点を共有するかどうか
+  bool isAdjacent( int fa, int fb ) const {
+    for ( int m = 0; m < 3; ++m )
+      for ( int n = 0; n < 3; ++n )
+        if ( verts_a_[ 3 * fa + m ] == verts_a_[ 3 * fb + n ] ) return true;
+    return false;
+  };
+
+  // 三角形の AABB が重なるかどうか
+  static bool isTriBoxOverlap( const OctreeTri& ta, const OctreeTri& tb ) {
+    for ( int j = 0; j < 3; ++j ) {
+      double a0 = ta.v0[j], a1 = a0 + ta.e1[j], a2 = a0 + ta.e2[j];
+      double b0 = tb.v0[j], b1 = b0 + tb.e1[j], b2 = b0 + tb.e2[j];
+      if ( std::max( a0, std::max( a1, a2 ) ) < std::min( b0, std::min( b1, b2 ) ) ) return false;
+      if ( std::max( b0, std::max( b1, b2 ) ) < std::min( a0, std::min( a1, a2 ) ) ) return false;
+    }
+    return true;
+  };
+
+  static bool isTriTriIntersect( const OctreeTri& ta, const OctreeTri& tb ) {
+    double a1[3], a2[3], b1[3], b2[3];
+    for ( int j = 0; j < 3; ++j ) {
+      a1[j] = ta.v0[j] + ta.e1[j]; a2[j] = ta.v0[j] + ta.e2[j];
+      b1[j] = tb.v0[j] + tb.e1[j]; b2[j] = tb.v0[j] + tb.e2[j];
+    }
+    return NoDivTriTriIsect( ta.v0, a1, a2, tb.v0, b1, b2 ) ? true : false;
+  };
+
+  bool self_;
+  std::vector<VertexL*> verts_a_;
+  std::vector<Task> tasks_;
+  long long n_box_pairs_;
+  long long n_tri_tests_;
+};
+
+#endif // _OCTREEINTERSECT_HXX
@@ -0,0 +1,498 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: OctreeSDF.hxx 2026/10/18 16:37:15 kanai Exp $
+//
+// Copyright (c) 2026 by Takashi Kanai. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef _OCTREESDF_HXX
+#define _OCTREESDF_HXX 1
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+#include <limits>
+using namespace std;
+
+#include "myEigen.hxx"
+#include "MeshL.hxx"
+
+#include "Octree.hxx"
+#include "ThreadPool.hxx"
+
+//
+// 疎なブロックグリッド上の符号付き距離場 (SDF)
+// - 格子点 (i, j, k) の位置は origin + h * (i, j, k)
+// - 格子点を BLOCK^3 個ずつのブロックにまとめ，表面から band 以内に
+//   かかるブロックだけを確保する
+// - 距離は Octree::closestPoint() で求め，符号は最近点の位置 (面，辺，頂点) に応じた
+//   角度重み付きの擬似法線との内積で決める (内部が負)
+// - 確保しないブロックは表面から band より遠いので，ブロックごとに内外の符号だけを持つ
+//   J. A. Baerentzen and H. Aanaes, "Signed distance computation using the angle
+//   weighted pseudonormal", IEEE TVCG 11(3), 2005.
+// - メッシュは閉じていて向きがそろっていることを前提とする
+//
+class OctreeSDF {
+
+public:
+
+  enum { BLOCK = 8 };
+
+  OctreeSDF() : h_(1.0), band_(1.0) { n_[0] = n_[1] = n_[2] = 0; nb_[0] = nb_[1] = nb_[2] = 0; };
+  ~OctreeSDF() {};
+
+  //
+  // 格子間隔 h, 幅 band の SDF を構築する
+  // - mesh は octree に格納した面を持つメッシュ (頂点の id を振り直す)
+  // - ブロックごとに並列に標本化し，band より遠い格子点は符号だけを隣から伝播させる
+  //
+  void build( Octree& octree, MeshL& mesh, double h, double band,
+              ThreadPool& pool = ThreadPool::instance() ) {
+    h_ = h;
+    // 符号の伝播 (propagateSign) のため band は格子間隔より十分に広くとる
+    band_ = std::max( band, 2.0 * h );
+    calcPseudoNormals( octree, mesh );
+
+    // 格子の範囲: バウンディングボックスを band だけ広げる
+    Eigen::Vector3d bbmin = octree.getBBmin(), bbmax = octree.getBBmax();
+    origin_ = bbmin - Eigen::Vector3d( band_, band_, band_ );
+    for ( int j = 0; j < 3; ++j ) {
+      n_[j] = (int) std::ceil( ( bbmax[j] - bbmin[j] + 2.0 * band_ ) / h_ ) + 1;
+      nb_[j] = ( n_[j] + BLOCK - 1 ) / BLOCK;
+    }
+
+    // 三角形の AABB を band だけ広げた範囲にかかるブロックを確保する
+    block_id_.assign( (size_t) nb_[0] * nb_[1] * nb_[2], -1 );
+    blocks_.clear();
+    for ( int f = 0; f < octree.faces_size(); ++f ) {
+      const OctreeTri& tri = tris_[f];
+      int b0[3], b1[3];
+      for ( int j = 0; j < 3; ++j ) {
+        double a = tri.v0[j], b = a + tri.e1[j], c = a + tri.e2[j];
+        double lo = std::min( a, std::min( b, c ) ) - band_;
+        double hi = std::max( a, std::max( b, c ) ) + band_;
+        b0[j] = std::max( (int) std::floor( ( lo - origin_[j] ) / ( h_ * BLOCK ) ), 0 );
+        b1[j] = std::min( (int) std::floor( ( hi - origin_[j] ) / ( h_ * BLOCK ) ), nb_[j] - 1 );
+      }
+      for ( int k = b0[2]; k <= b1[2]; ++k )
+        for ( int j = b0[1]; j <= b1[1]; ++j )
+          for ( int i = b0[0]; i <= b1[0]; ++i ) {
+            int& id = block_id_[ blockIndex( i, j, k ) ];
+            if ( id >= 0 ) continue;
+            id = (int) blocks_.size();
+            blocks_.push_back( Block( i, j, k ) );
+          }
+    }
+
+    parallelFor( pool, 0, (int) blocks_.size(), 1, [&]( int b ) { sampleBlock( octree, blocks_[b] ); } );
+    propagateSign( octree );
+    signBlocks();
+  };
+
+  double cellSize() const { return h_; };
+  double band() const { return band_; };
+  const Eigen::Vector3d& origin() const { return origin_; };
+  int nx() const { return n_[0]; };
+  int ny() const { return n_[1]; };
+  int nz() const { return n_[2]; };
+  int blocks_size() const { return (int) blocks_.size(); };
+
+  // 格子点 (i, j, k) が確保したブロックにあれば true
+  bool has( int i, int j, int k ) const { return ( find( i, j, k ) != NULL ) ? true : false; };
+
+  // 格子点 (i, j, k) の値 (確保していなければブロックの符号を付けた band．格子の外は band)
+  double value( int i, int j, int k ) const {
+    const float* v = find( i, j, k );
+    if ( v != NULL ) return (double) *v;
+    if ( ( i < 0 ) || ( j < 0 ) || ( k < 0 ) || ( i >= n_[0] ) || ( j >= n_[1] ) || ( k >= n_[2] ) ) return band_;
+    return ( block_sign_[ blockIndex( i / BLOCK, j / BLOCK, k / BLOCK ) ] < 0 ) ? -band_ : band_;
+  };
+
+  //
+  // 点 p の符号付き距離を 3 線形補間で求める
+  // 確保していない格子点は value() と同じく符号付きの band とする (格子の外は band)
+  //
+  double sample( const Eigen::Vector3d& p ) const {
+    double x[3];
+    int c[3];
+    for ( int j = 0; j < 3; ++j ) {
+      double g = ( p[j] - origin_[j] ) / h_;
+      if ( !( g >= .0 ) || ( g >= (double) ( n_[j] - 1 ) ) ) return band_;
+      c[j] = (int) g;
+      x[j] = g - c[j];
+    }
+    double v[8];
+    for ( int m = 0; m < 8; ++m )
+      v[m] = value( c[0] + ( m & 1 ), c[1] + ( ( m >> 1 ) & 1 ), c[2] + ( ( m >> 2 ) & 1 ) );
+    double vx0 = v[0] + ( v[1] - v[0] ) * x[0], vx1 = v[2] + ( v[3] - v[2] ) * x[0];
+    double vx2 = v[4] + ( v[5] - v[4] ) * x[0], vx3 = v[6] + ( v[7] - v[6] ) * x[0];
+    double vy0 = vx0 + ( vx1 - vx0 ) * x[1], vy1 = vx2 + ( vx3 - vx2 ) * x[1];
+    return vy0 + ( vy1 - vy0 ) * x[2];
+  };
+
+  //
+  // 等値面 (値 iso) を三角形メッシュとして out に出力する
+  // - 各セルを主対角線を共有する 6 個の四面体に分けて等値面を張る (marching tetrahedra)
+  //   どのセルも同じ分け方なので，隣のセルとの間に穴は開かない
+  // - 面は負 (内部) から正 (外部) の向きを法線とする
+  // - 同じ格子の辺上の頂点は共有する
+  //
+  void extract( MeshL& out, double iso = .0, ThreadPool& pool = ThreadPool::instance() ) {
+    std::vector<std::vector<ExtTri> > tris( blocks_.size() );
+    parallelFor( pool, 0, (int) blocks_.size(), 1, [&]( int b ) { extractBlock( blocks_[b], iso, tris[b] ); } );
+
+    std::unordered_map<uint64_t, VertexL*> vmap;
+    for ( auto& bt : tris )
+      for ( auto& t : bt ) {
+        FaceL* fc = out.addFace();
+        for ( int m = 0; m < 3; ++m ) {
+          VertexL*& vt = vmap[ t.key[m] ];
+          if ( vt == NULL ) vt = out.addVertex( t.p[m] );
+          out.addHalfedge( fc, vt, NULL );
+        }
+        fc->calcNormal();
+      }
+  };
+
+private:
+
+  // 格子点 BLOCK^3 個のブロック
+  struct Block {
+    int bi, bj, bk;
+    std::vector<float> v;
+    Block( int i, int j, int k ) : bi(i), bj(j), bk(k) {};
+  };
+
+  // 抽出した三角形 (頂点の位置と，頂点がのる格子の辺のキー)
+  struct ExtTri {
+    Eigen::Vector3d p[3];
+    uint64_t key[3];
+  };
+
+  size_t blockIndex( int i, int j, int k ) const { return ( (size_t) k * nb_[1] + j ) * nb_[0] + i; };
+
+  // band より遠く，まだ値が決まっていない格子点の印
+  static float unknown() { return std::numeric_limits<float>::max(); };
+
+  float* at( int i, int j, int k ) { return const_cast<float*>( find( i, j, k ) ); };
+
+  const float* find( int i, int j, int k ) const {
+    if ( ( i < 0 ) || ( j < 0 ) || ( k < 0 ) || ( i >= n_[0] ) || ( j >= n_[1] ) || ( k >= n_[2] ) ) return NULL;
+    int id = block_id_[ blockIndex( i / BLOCK, j / BLOCK, k / BLOCK ) ];
+    if ( id < 0 ) return NULL;
+    return &( blocks_[id].v[ ( ( k % BLOCK ) * BLOCK + ( j % BLOCK ) ) * BLOCK + ( i % BLOCK ) ] );
+  };
+
+  uint64_t nodeIndex( int i, int j, int k ) const {
+    return ( (uint64_t) k * n_[1] + j ) * n_[0] + i;
+  };
+
+  //
+  // 面，辺，頂点の角度重み付き擬似法線
+  // - 面 f の 3 頂点は Octree の三角形のレコードと同じ (最初の 3 頂点)
+  // - 辺の擬似法線は両側の面の法線の和，頂点の擬似法線は頂点での角度で重み付けした和
+  //
+  void calcPseudoNormals( Octree& octree, MeshL& mesh ) {
+    mesh.resetVertexID();
+    int n_f = octree.faces_size();
+    tris_.resize( n_f );
+    fn_.resize( n_f );
+    fvid_.resize( 3 * n_f );
+    vn_.assign( mesh.vertices_size(), Eigen::Vector3d::Zero() );
+    face_index_.clear();
+    std::unordered_map<uint64_t, Eigen::Vector3d> en;
+
+    for ( int f = 0; f < n_f; ++f ) {
+      FaceL* fc = octree.face( f );
+      face_index_[fc] = f;
+      tris_[f].set( fc, f );
+      auto he = fc->halfedges().begin();
+      for ( int m = 0; m < 3; ++m, ++he ) fvid_[ 3 * f + m ] = (*he)->vertex()->id();
+
+      Eigen::Vector3d p[3] = { tris_[f].point(0), tris_[f].point(1), tris_[f].point(2) };
+      Eigen::Vector3d n = ( p[1] - p[0] ).cross( p[2] - p[0] );
+      if ( n.norm() > .0 ) n.normalize();
+      fn_[f] = n;
+
+      for ( int m = 0; m < 3; ++m ) {
+        Eigen::Vector3d a = p[ ( m + 1 ) % 3 ] - p[m], b = p[ ( m + 2 ) % 3 ] - p[m];
+        double la = a.norm(), lb = b.norm();
+        double angle = ( ( la > .0 ) && ( lb > .0 ) )
+          ? std::acos( std::max( -1.0, std::min( 1.0, a.dot( b ) / ( la * lb ) ) ) ) : .0;
+        vn_[ fvid_[ 3 * f + m ] ] += angle * n;
+        en[ edgeKey( fvid_[ 3 * f + m ], fvid_[ 3 * f + ( m + 1 ) % 3 ] ) ] += n;
+      }
+    }
+
+    // 辺 m は頂点 m と m+1 を結ぶ
+    en_.resize( 3 * n_f );
+    for ( int f = 0; f < n_f; ++f )
+      for ( int m = 0; m < 3; ++m )
+        en_[ 3 * f + m ] = en[ edgeKey( fvid_[ 3 * f + m ], fvid_[ 3 * f + ( m + 1 ) % 3 ] ) ];
+  };
+
+  static uint64_t edgeKey( int a, int b ) {
+    if ( a > b ) std::swap( a, b );
+    return ( (uint64_t) (uint32_t) a << 32 ) | (uint32_t) b;
+  };
+
+  //
+  // 最近点の位置に応じた擬似法線
+  // bc は最近点の重心座標．0 の成分が 2 つなら頂点，1 つなら辺，なければ面の内部
+  //
+  const Eigen::Vector3d& pseudoNormal( int f, const double bc[3] ) const {
+    int zero = 0, last = 0;
+    for ( int m = 0; m < 3; ++m ) if ( bc[m] <= .0 ) { ++zero; last = m; }
+    if ( zero == 0 ) return fn_[f];
+    if ( zero == 1 ) return en_[ 3 * f + ( last + 1 ) % 3 ];
+    for ( int m = 0; m < 3; ++m ) if ( bc[m] > .0 ) return vn_[ fvid_[ 3 * f + m ] ];
+    return fn_[f];
+  };
+
+  //
+  // 点 p の符号付き距離
+  // - unbounded が false のとき，band より遠ければ unknown() を返す
+  // - unbounded が true のとき，band より遠ければ符号付きの band を返す
+  //
+  double signedDistance( Octree& octree, const Eigen::Vector3d& p, bool unbounded = false ) const {
+    ClosestHit hit = octree.closestPoint( p, band_ );
+    bool far = !hit.isHit();
+    if ( far ) {
+      if ( !unbounded ) return unknown();
+      hit = octree.closestPoint( p );
+      if ( !hit.isHit() ) return band_;
+    }
+    int f = faceIndex( hit.face );
+    double s = ( f >= 0 ) ? ( p - hit.point ).dot( pseudoNormal( f, hit.bc ) ) : 1.0;
+    double d = far ? band_ : hit.distance;
+    return ( s < .0 ) ? -d : d;
+  };
+
+  //
+  // band より遠い格子点 (unknown()) の値を，6 近傍の格子点から符号だけ伝播させて決める
+  // - 隣り合う格子点の間に表面があれば両方とも band (> h) 以内なので，
+  //   band の外の格子点の符号は隣の格子点と同じになる
+  // - どの格子点からも伝播しない連結成分は，最初の 1 点だけ最近点を探索して符号を決める
+  //
+  void propagateSign( Octree& octree ) {
+    static const int nb[6][3] = {
+      { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+
+    std::vector<int> queue;   // 格子点 (i, j, k) を 3 つずつ積む
+    auto push = [&]( int i, int j, int k ) { queue.push_back( i ); queue.push_back( j ); queue.push_back( k ); };
+    auto flood = [&]() {
+      for ( size_t q = 0; q < queue.size(); q += 3 ) {
+        float s = *at( queue[q], queue[q+1], queue[q+2] );
+        for ( int n = 0; n < 6; ++n ) {
+          int x = queue[q] + nb[n][0], y = queue[q+1] + nb[n][1], z = queue[q+2] + nb[n][2];
+          float* v = at( x, y, z );
+          if ( ( v == NULL ) || ( *v != unknown() ) ) continue;
+          *v = ( s < .0f ) ? (float) -band_ : (float) band_;
+          push( x, y, z );
+        }
+      }
+      queue.clear();
+    };
+
+    // band 以内の格子点から伝播させ，残った連結成分は 1 点ずつ符号を求めてから伝播させる
+    // (ブロックの端数で格子の範囲外になる格子点は除く)
+    for ( int pass = 0; pass < 2; ++pass ) {
+      for ( auto& blk : blocks_ )
+        for ( int k = 0; k < BLOCK; ++k )
+          for ( int j = 0; j < BLOCK; ++j )
+            for ( int i = 0; i < BLOCK; ++i ) {
+              int x = blk.bi * BLOCK + i, y = blk.bj * BLOCK + j, z = blk.bk * BLOCK + k;
+              if ( ( x >= n_[0] ) || ( y >= n_[1] ) || ( z >= n_[2] ) ) continue;
+              float& v = blk.v[ ( k * BLOCK + j ) * BLOCK + i ];
+              if ( pass == 0 ) {
+                if ( v != unknown() ) push( x, y, z );
+              } else if ( v == unknown() ) {
+                v = (float) signedDistance( octree, origin_ + h_ * Eigen::Vector3d( x, y, z ), true );
+                push( x, y, z );
+                flood();
+              }
+            }
+      flood();
+    }
+  };
+
+  //
+  // 確保しないブロックの内外の符号 (block_sign_) を決める
+  // - 確保しないブロックの範囲には，どの三角形からも band (>= 2h) 以内の点がない
+  //   よって隣の確保したブロックの，境界をはさんで h 以内の格子点と符号が同じになる
+  // - 確保したブロックに接しないものは，隣の確保しないブロックから幅優先で伝播させる
+  //
+  void signBlocks() {
+    static const int nb[6][3] = {
+      { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+
+    block_sign_.assign( block_id_.size(), 0 );
+    std::vector<int> queue;   // ブロック (i, j, k) を 3 つずつ積む
+    for ( int k = 0; k < nb_[2]; ++k )
+      for ( int j = 0; j < nb_[1]; ++j )
+        for ( int i = 0; i < nb_[0]; ++i ) {
+          if ( block_id_[ blockIndex( i, j, k ) ] >= 0 ) continue;
+          for ( int n = 0; n < 6; ++n ) {
+            int b[3] = { i + nb[n][0], j + nb[n][1], k + nb[n][2] };
+            if ( ( b[0] < 0 ) || ( b[1] < 0 ) || ( b[2] < 0 ) ||
+                 ( b[0] >= nb_[0] ) || ( b[1] >= nb_[1] ) || ( b[2] >= nb_[2] ) ) continue;
+            if ( block_id_[ blockIndex( b[0], b[1], b[2] ) ] < 0 ) continue;
+            // 隣のブロックのうち，このブロックに最も近い面の格子点
+            int c[3] = { i * BLOCK, j * BLOCK, k * BLOCK };
+            for ( int m = 0; m < 3; ++m ) {
+              if ( nb[n][m] < 0 ) c[m] -= 1;
+              else if ( nb[n][m] > 0 ) c[m] = b[m] * BLOCK;
+            }
+            const float* v = find( c[0], c[1], c[2] );
+            block_sign_[ blockIndex( i, j, k ) ] = ( ( v != NULL ) && ( *v < .0f ) ) ? -1 : 1;
+            queue.push_back( i ); queue.push_back( j ); queue.push_back( k );
+            break;
+          }
+        }
+
+    for ( size_t q = 0; q < queue.size(); q += 3 ) {
+      signed char s = block_sign_[ blockIndex( queue[q], queue[q+1], queue[q+2] ) ];
+      for ( int n = 0; n < 6; ++n ) {
+        int x = queue[q] + nb[n][0], y = queue[q+1] + nb[n][1], z = queue[q+2] + nb[n][2];
+        if ( ( x < 0 ) || ( y < 0 ) || ( z < 0 ) || ( x >= nb_[0] ) || ( y >= nb_[1] ) || ( z >= nb_[2] ) ) continue;
+        size_t id = blockIndex( x, y, z );
+        if ( ( block_id_[id] >= 0 ) || ( block_sign_[id] != 0 ) ) continue;
+        block_sign_[id] = s;
+        queue.push_back( x ); queue.push_back( y ); queue.push_back( z );
+      }
+    }
+  };
+
+  // ClosestHit の面から三角形の番号を引く
+  int faceIndex( FaceL* fc ) const {
+    auto it = face_index_.find( fc );
+    return ( it != face_index_.end() ) ? it->second : -1;
+  };
+
+  void sampleBlock( Octree& octree, Block& blk ) {
+    blk.v.resize( BLOCK * BLOCK * BLOCK );
+    for ( int k = 0; k < BLOCK; ++k )
+      for ( int j = 0; j < BLOCK; ++j )
+        for ( int i = 0; i < BLOCK; ++i ) {
+          int x = blk.bi * BLOCK + i, y = blk.bj * BLOCK + j, z = blk.bk * BLOCK + k;
+          float& v = blk.v[ ( k * BLOCK + j ) * BLOCK + i ];
+          v = (float) signedDistance( octree, origin_ + h_ * Eigen::Vector3d( x, y, z ) );
+          // 格子の外周はバウンディングボックスより band だけ外側にあるので必ず外部
+          if ( ( v == unknown() ) && ( ( x == 0 ) || ( y == 0 ) || ( z == 0 ) ||
+                                       ( x >= n_[0] - 1 ) || ( y >= n_[1] - 1 ) || ( z >= n_[2] - 1 ) ) )
+            v = (float) band_;
+        }
+  };
+
+  // ブロック内のセル (8 隅の格子点がすべて確保されているもの) から等値面を張る
+  void extractBlock( const Block& blk, double iso, std::vector<ExtTri>& tris ) const {
+    // 主対角線 0-7 を共有する 6 個の四面体 (隅の番号 m は bit0: x, bit1: y, bit2: z)
+    static const int tet[6][4] = {
+      { 0, 1, 3, 7 }, { 0, 3, 2, 7 }, { 0, 2, 6, 7 },
+      { 0, 6, 4, 7 }, { 0, 4, 5, 7 }, { 0, 5, 1, 7 } };
+
+    for ( int k = 0; k < BLOCK; ++k )
+      for ( int j = 0; j < BLOCK; ++j )
+        for ( int i = 0; i < BLOCK; ++i ) {
+          int c[3] = { blk.bi * BLOCK + i, blk.bj * BLOCK + j, blk.bk * BLOCK + k };
+          double v[8];
+          uint64_t id[8];
+          Eigen::Vector3d p[8];
+          int n_neg = 0;
+          bool ok = true;
+          for ( int m = 0; ok && ( m < 8 ); ++m ) {
+            int x = c[0] + ( m & 1 ), y = c[1] + ( ( m >> 1 ) & 1 ), z = c[2] + ( ( m >> 2 ) & 1 );
+            const float* f = find( x, y, z );
+            if ( f == NULL ) { ok = false; break; }
+            v[m] = *f - iso;
+            if ( v[m] < .0 ) ++n_neg;
+            id[m] = nodeIndex( x, y, z );
+            p[m] = origin_ + h_ * Eigen::Vector3d( x, y, z );
+          }
+          if ( !ok || ( n_neg == 0 ) || ( n_neg == 8 ) ) continue;
+
+          for ( int t = 0; t < 6; ++t ) polygonizeTet( tet[t], v, id, p, tris );
+        }
+  };
+
+  // 四面体 (隅の番号 q) の等値面
+  void polygonizeTet( const int q[4], const double v[8], const uint64_t id[8],
+                      const Eigen::Vector3d p[8], std::vector<ExtTri>& tris ) const {
+    int neg[4], pos[4], nn = 0, np = 0;
+    for ( int m = 0; m < 4; ++m ) {
+      if ( v[ q[m] ] < .0 ) neg[nn++] = q[m]; else pos[np++] = q[m];
+    }
+    if ( ( nn == 0 ) || ( np == 0 ) ) return;
+
+    // 負の頂点から正の頂点への向き (法線の向きの基準)
+    Eigen::Vector3d cn = Eigen::Vector3d::Zero(), cp = Eigen::Vector3d::Zero();
+    for ( int m = 0; m < nn; ++m ) cn += p[ neg[m] ];
+    for ( int m = 0; m < np; ++m ) cp += p[ pos[m] ];
+    Eigen::Vector3d dir = cp / np - cn / nn;
+
+    // 負と正の頂点を結ぶ辺上の交点
+    Eigen::Vector3d ep[4];
+    uint64_t ek[4];
+    int ne = 0;
+    for ( int a = 0; a < nn; ++a )
+      for ( int b = 0; b < np; ++b ) {
+        int u = neg[a], w = pos[b];
+        double t = v[u] / ( v[u] - v[w] );
+        ep[ne] = p[u] + t * ( p[w] - p[u] );
+        uint64_t i0 = std::min( id[u], id[w] ), i1 = std::max( id[u], id[w] );
+        ek[ne++] = i0 * 8 + edgeDir( i0, i1 );
+      }
+
+    if ( ne == 3 ) {
+      addTri( ep[0], ep[1], ep[2], ek[0], ek[1], ek[2], dir, tris );
+    } else {
+      // 2 対 2 のとき，交点は (n0p0, n0p1, n1p0, n1p1) の順なので四角形 n0p0-n0p1-n1p1-n1p0
+      addTri( ep[0], ep[1], ep[3], ek[0], ek[1], ek[3], dir, tris );
+      addTri( ep[0], ep[3], ep[2], ek[0], ek[3], ek[2], dir, tris );
+    }
+  };
+
+  // 格子点 i0 < i1 を結ぶ辺の向き (セルの辺，面の対角線，主対角線の 7 通り)
+  uint64_t edgeDir( uint64_t i0, uint64_t i1 ) const {
+    uint64_t d = i1 - i0, nx = n_[0], nxy = (uint64_t) n_[0] * n_[1];
+    int dx = 0, dy = 0, dz = 0;
+    if ( d >= nxy ) { dz = 1; d -= nxy; }
+    if ( d >= nx ) { dy = 1; d -= nx; }
+    if ( d >= 1 ) dx = 1;
+    return (uint64_t) ( dx | ( dy << 1 ) | ( dz << 2 ) );
+  };
+
+  static void addTri( const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& c,
+                      uint64_t ka, uint64_t kb, uint64_t kc, const Eigen::Vector3d& dir,
+                      std::vector<ExtTri>& tris ) {
+    ExtTri t;
+    t.p[0] = a; t.key[0] = ka;
+    if ( ( b - a ).cross( c - a ).dot( dir ) >= .0 ) {
+      t.p[1] = b; t.key[1] = kb;
+      t.p[2] = c; t.key[2] = kc;
+    } else {
+      t.p[1] = c; t.key[1] = kc;
+      t.p[2] = b; t.key[2] = kb;
+    }
+    tris.push_back( t );
+  };
+
+  double h_, band_;
+  Eigen::Vector3d origin_;
+  int n_[3];    // 格子点の数
+  int nb_[3];   // ブロックの数
+  std::vector<int> block_id_;
+  std::vector<signed char> block_sign_;   // 確保しないブロックの符号 (内部が -1)
+  std::vector<Block> blocks_;
+
+  // 擬似法線
+  std::vector<OctreeTri> tris_;
+  std::vector<Eigen::Vector3d> fn_, en_, vn_;
+  std::vector<int> fvid_;
+  std::unordered_map<FaceL*, int> face_index_;
+};
+
+#endif // _OCTREESDF_HXX
@@ -0,0 +1,105 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: OctreeTri.hxx 2026/10/18 12:31:44 kanai Exp $
+//
+// Copyright (c) 2026 by Takashi Kanai. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef _OCTREETRI_HXX
+#define _OCTREETRI_HXX 1
+
+using namespace std;
+
+#include "myEigen.hxx"
+#include "FaceL.hxx"
+
+//
+// Octree の葉に格納する三角形のレコード
+// - 頂点 v0 と辺ベクトル e1 = v1 - v0, e2 = v2 - v0 を連続したメモリに持ち，
+//   交差判定のたびにハーフエッジのリストを辿らなくて済むようにする
+// - id は Octree のルートが持つ面の表 (Octree::face(id)) の番号
+//
+struct OctreeTri {
+  double v0[3];
+  double e1[3];
+  double e2[3];
+  int id;
+
+  OctreeTri() : id(-1) {};
+
+  // 面 fc からレコードを作る
+  void set( FaceL* fc, int i ) {
+    auto he = fc->halfedges().begin();
+    Eigen::Vector3d& p0 = (*he)->vertex()->point(); ++he;
+    Eigen::Vector3d& p1 = (*he)->vertex()->point(); ++he;
+    Eigen::Vector3d& p2 = (*he)->vertex()->point();
+    for ( int j = 0; j < 3; ++j ) {
+      v0[j] = p0[j];
+      e1[j] = p1[j] - p0[j];
+      e2[j] = p2[j] - p0[j];
+    }
+    id = i;
+  };
+
+  // 頂点と id が同じかどうか
+  bool same( const OctreeTri& t ) const {
+    for ( int j = 0; j < 3; ++j ) {
+      if ( ( v0[j] != t.v0[j] ) || ( e1[j] != t.e1[j] ) || ( e2[j] != t.e2[j] ) ) return false;
+    }
+    return ( id == t.id );
+  };
+
+  // k 番目 (0, 1, 2) の頂点
+  Eigen::Vector3d point( int k ) const {
+    if ( k == 1 ) return Eigen::Vector3d( v0[0] + e1[0], v0[1] + e1[1], v0[2] + e1[2] );
+    if ( k == 2 ) return Eigen::Vector3d( v0[0] + e2[0], v0[1] + e2[1], v0[2] + e2[2] );
+    return Eigen::Vector3d( v0[0], v0[1], v0[2] );
+  };
+};
+
+//
+// 1 回の問い合わせ (レイ，パケット，点) の中で判定済みの三角形を記録するメールボックス
+// - 面は重なる全ての葉に入るので，複数の葉を通るレイは同じ三角形を何度も判定しうる
+// - id の下位ビットで引く直接マップ方式の小さな表で，衝突したら上書きする
+//   (上書きで忘れた三角形は判定し直すだけなので結果は変わらない)
+// - パケットではレーンごとのマスクも記録し，未判定のレーンだけを判定する
+//
+struct TriMailbox {
+  enum { SIZE = 32 };
+
+  int tag[SIZE];
+  unsigned int lanes[SIZE];
+  int tested;    // 判定した三角形の数
+  int skipped;   // 判定済みのため省いた三角形の数
+
+  TriMailbox() : tested(0), skipped(0) {
+    for ( int i = 0; i < SIZE; ++i ) tag[i] = -1;
+  };
+
+  // id が判定済みなら true，未判定なら記録して false
+  bool visited( int id ) {
+    int& t = tag[ id & (SIZE - 1) ];
+    if ( t == id ) { ++skipped; return true; }
+    t = id;
+    ++tested;
+    return false;
+  };
+
+  // mask のレーンのうち id をまだ判定していないレーンのマスクを返し，判定済みとして記録する
+  unsigned int untested( int id, unsigned int mask ) {
+    int i = id & (SIZE - 1);
+    unsigned int m = mask;
+    if ( tag[i] == id ) {
+      m = mask & ~lanes[i];
+      lanes[i] |= mask;
+    } else {
+      tag[i] = id;
+      lanes[i] = mask;
+    }
+    if ( m ) ++tested; else ++skipped;
+    return m;
+  };
+};
+
+#endif // _OCTREETRI_HXX
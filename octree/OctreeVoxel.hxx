@@ -0,0 +1,348 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: OctreeVoxel.hxx 2026/10/18 15:54:03 kanai Exp $
+//
+// Copyright (c) 2026 by Takashi Kanai. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef _OCTREEVOXEL_HXX
+#define _OCTREEVOXEL_HXX 1
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+#include "myEigen.hxx"
+
+#include "Octree.hxx"
+#include "ThreadPool.hxx"
+
+//
+// 1 セル 1 ビットの 3 次元グリッド
+// - セル (i, j, k) のビット番号は ( k * ny + j ) * nx + i
+// - 64 セルずつ uint64_t に詰める
+//
+struct VoxelGrid {
+  int nx, ny, nz;
+  Eigen::Vector3d origin;   // セル (0, 0, 0) の最小の角
+  double h;                 // セルの一辺の長さ
+  std::vector<uint64_t> bits;
+
+  VoxelGrid() : nx(0), ny(0), nz(0), origin(Eigen::Vector3d::Zero()), h(1.0) {};
+
+  void resize( int x, int y, int z ) {
+    nx = x; ny = y; nz = z;
+    bits.assign( ( (size_t) nx * ny * nz + 63 ) / 64, 0 );
+  };
+  size_t index( int i, int j, int k ) const { return ( (size_t) k * ny + j ) * nx + i; };
+  bool get( int i, int j, int k ) const {
+    size_t id = index( i, j, k );
+    return ( ( bits[ id >> 6 ] >> ( id & 63 ) ) & 1 ) ? true : false;
+  };
+  void set( int i, int j, int k ) {
+    size_t id = index( i, j, k );
+    bits[ id >> 6 ] |= (uint64_t) 1 << ( id & 63 );
+  };
+  // 立っているビットの数
+  size_t count() const {
+    size_t n = 0;
+    for ( auto b : bits ) for ( uint64_t w = b; w; w &= w - 1 ) ++n;
+    return n;
+  };
+};
+
+//
+// Octree を使ったソリッドボクセル化と内外判定
+// - 表面のセル: Octree の葉に入っている三角形について，葉と三角形の AABB に
+//   重なるセルだけを Octree::isFaceOveralapBox() (triBoxOverlap) で判定する
+// - 内部のセルの求め方は 2 通り
+//   FLOOD_FILL: グリッドの外周から表面のセルを通らずに 6 近傍で辿れるセルを外部，
+//               残りを内部とする．メッシュが閉じていなければ外部とつながるので内部は空になる
+//   PARITY: x, y, z 軸に平行なセルの列ごとにレイを飛ばし，セルの中心までの交点の数が
+//           奇数なら内部とする．3 軸の多数決を取るので小さな穴があってもよい
+// - 内外判定は各セルのラベルを引くだけで，表面のセルにある点のみ，
+//   隣の表面でないセルの中心までの線分とメッシュとの交点の数の偶奇で決める
+//
+class OctreeVoxel {
+
+public:
+
+  enum { OUTSIDE = 0, SURFACE = 1, INSIDE = 2 };
+  enum { FLOOD_FILL = 0, PARITY = 1 };
+
+  OctreeVoxel() : octree_(NULL), fill_mode_(FLOOD_FILL), nx_(0), ny_(0), nz_(0), h_(1.0) {};
+  ~OctreeVoxel() {};
+
+  // 内部のセルの求め方 (FLOOD_FILL または PARITY)
+  void setFillMode( int m ) { fill_mode_ = m; };
+  int fillMode() const { return fill_mode_; };
+
+  //
+  // メッシュのバウンディングボックスの最長辺を res 等分する立方体のセルでボクセル化する
+  // - グリッドの外周には外部のセルを 1 層加える
+  //
+  void voxelize( Octree& octree, int res, ThreadPool& pool = ThreadPool::instance() ) {
+    octree_ = &octree;
+    res = std::max( res, 1 );
+
+    Eigen::Vector3d bbmin = octree.getBBmin(), bbmax = octree.getBBmax();
+    Eigen::Vector3d ext = bbmax - bbmin;
+    h_ = std::max( ext.maxCoeff(), std::numeric_limits<double>::min() ) / (double) res;
+    int n[3];
+    for ( int j = 0; j < 3; ++j ) n[j] = std::max( 1, (int) std::ceil( ext[j] / h_ - 1.0e-9 ) ) + 2;
+    nx_ = n[0]; ny_ = n[1]; nz_ = n[2];
+    origin_ = bbmin - Eigen::Vector3d( h_, h_, h_ );
+
+    labels_.assign( (size_t) nx_ * ny_ * nz_, (unsigned char) OUTSIDE );
+    markSurface( octree, pool );
+    if ( fill_mode_ == PARITY ) fillParity( pool ); else fillInterior();
+  };
+
+  int nx() const { return nx_; };
+  int ny() const { return ny_; };
+  int nz() const { return nz_; };
+  double cellSize() const { return h_; };
+  const Eigen::Vector3d& origin() const { return origin_; };
+
+  // セルのラベル (OUTSIDE, SURFACE, INSIDE)
+  int label( int i, int j, int k ) const { return labels_[ index( i, j, k ) ]; };
+
+  //
+  // 占有グリッド (表面または内部のセルのビットが立つ) を grid に出力する
+  // surface_only が true なら表面のセルのみ
+  //
+  void getGrid( VoxelGrid& grid, bool surface_only = false ) const {
+    grid.resize( nx_, ny_, nz_ );
+    grid.origin = origin_;
+    grid.h = h_;
+    for ( int k = 0; k < nz_; ++k )
+      for ( int j = 0; j < ny_; ++j )
+        for ( int i = 0; i < nx_; ++i ) {
+          int l = label( i, j, k );
+          if ( ( l == SURFACE ) || ( !surface_only && ( l == INSIDE ) ) ) grid.set( i, j, k );
+        }
+  };
+
+  //
+  // 点 p がメッシュの内部にあれば true
+  //
+  bool isInside( const Eigen::Vector3d& p ) {
+    int c[3];
+    if ( !cellOf( p, c ) ) return false;
+    int l = label( c[0], c[1], c[2] );
+    if ( l != SURFACE ) return ( l == INSIDE ) ? true : false;
+    return resolveSurface( p, c );
+  };
+
+  //
+  // 複数の点の内外判定 (内部なら inside[i] = 1)
+  //
+  void isInside( const std::vector<Eigen::Vector3d>& points, std::vector<char>& inside,
+                 ThreadPool& pool = ThreadPool::instance() ) {
+    int n = (int) points.size();
+    inside.resize( n );
+    parallelFor( pool, 0, n, 1024, [&]( int i ) { inside[i] = isInside( points[i] ) ? 1 : 0; } );
+  };
+
+private:
+
+  size_t index( int i, int j, int k ) const { return ( (size_t) k * ny_ + j ) * nx_ + i; };
+
+  // 点 p を含むセル．グリッドの外なら false
+  bool cellOf( const Eigen::Vector3d& p, int c[3] ) const {
+    int n[3] = { nx_, ny_, nz_ };
+    for ( int j = 0; j < 3; ++j ) {
+      double x = std::floor( ( p[j] - origin_[j] ) / h_ );
+      if ( !( x >= .0 ) || ( x >= (double) n[j] ) ) return false;
+      c[j] = (int) x;
+    }
+    return true;
+  };
+
+  //
+  // 表面のセルのラベル付け
+  // 葉ごとに並列に処理し，見つかったセルは葉ごとに集めてから書き込む
+  //
+  void markSurface( Octree& octree, ThreadPool& pool ) {
+    std::vector<Octree*> leaves;
+    collectLeaves( &octree, leaves );
+
+    std::vector<std::vector<size_t> > cells( leaves.size() );
+    // triBoxOverlap は float で判定するので，取りこぼさないようにセルを少し大きくする
+    double pad = 1.0e-4 * h_;
+    parallelFor( pool, 0, (int) leaves.size(), 1, [&]( int l ) {
+        Octree* leaf = leaves[l];
+        Eigen::Vector3d& lmin = leaf->getBBmin();
+        Eigen::Vector3d& lmax = leaf->getBBmax();
+        for ( int t = 0; t < leaf->tris_size(); ++t ) {
+          const OctreeTri& tri = leaf->tri( t );
+          // 三角形の AABB と葉のボックスの共通部分に重なるセルの範囲
+          int c0[3], c1[3];
+          bool empty = false;
+          for ( int j = 0; j < 3; ++j ) {
+            double a = tri.v0[j], b = a + tri.e1[j], c = a + tri.e2[j];
+            double lo = std::max( std::min( a, std::min( b, c ) ), lmin[j] ) - pad;
+            double hi = std::min( std::max( a, std::max( b, c ) ), lmax[j] ) + pad;
+            if ( lo > hi ) { empty = true; break; }
+            c0[j] = std::max( (int) std::floor( ( lo - origin_[j] ) / h_ ), 0 );
+            c1[j] = std::min( (int) std::floor( ( hi - origin_[j] ) / h_ ), dim( j ) - 1 );
+          }
+          if ( empty ) continue;
+
+          for ( int k = c0[2]; k <= c1[2]; ++k )
+            for ( int j = c0[1]; j <= c1[1]; ++j )
+              for ( int i = c0[0]; i <= c1[0]; ++i ) {
+                Eigen::Vector3d vmin = origin_ + h_ * Eigen::Vector3d( i, j, k ) - Eigen::Vector3d( pad, pad, pad );
+                Eigen::Vector3d vmax = vmin + Eigen::Vector3d( h_ + 2.0 * pad, h_ + 2.0 * pad, h_ + 2.0 * pad );
+                if ( octree.isFaceOveralapBox( tri, vmin, vmax ) ) cells[l].push_back( index( i, j, k ) );
+              }
+        }
+      } );
+
+    for ( auto& cl : cells )
+      for ( auto id : cl ) labels_[id] = SURFACE;
+  };
+
+  //
+  // 外周から 6 近傍で外部のセルを塗り，残りを内部のセルにする
+  //
+  void fillInterior() {
+    const unsigned char UNKNOWN = 3;
+    for ( auto& l : labels_ ) if ( l != SURFACE ) l = UNKNOWN;
+
+    std::vector<size_t> queue;
+    auto push = [&]( int i, int j, int k ) {
+      size_t id = index( i, j, k );
+      if ( labels_[id] != UNKNOWN ) return;
+      labels_[id] = OUTSIDE;
+      queue.push_back( id );
+    };
+    // 外周の 1 層は必ず外部
+    for ( int k = 0; k < nz_; ++k )
+      for ( int j = 0; j < ny_; ++j )
+        for ( int i = 0; i < nx_; ++i )
+          if ( ( i == 0 ) || ( j == 0 ) || ( k == 0 ) || ( i == nx_ - 1 ) || ( j == ny_ - 1 ) || ( k == nz_ - 1 ) )
+            push( i, j, k );
+
+    for ( size_t q = 0; q < queue.size(); ++q ) {
+      size_t id = queue[q];
+      int i = (int) ( id % nx_ );
+      int j = (int) ( ( id / nx_ ) % ny_ );
+      int k = (int) ( id / ( (size_t) nx_ * ny_ ) );
+      if ( i > 0 ) push( i - 1, j, k );
+      if ( i < nx_ - 1 ) push( i + 1, j, k );
+      if ( j > 0 ) push( i, j - 1, k );
+      if ( j < ny_ - 1 ) push( i, j + 1, k );
+      if ( k > 0 ) push( i, j, k - 1 );
+      if ( k < nz_ - 1 ) push( i, j, k + 1 );
+    }
+
+    for ( auto& l : labels_ ) if ( l == UNKNOWN ) l = INSIDE;
+  };
+
+  //
+  // 軸に平行なセルの列ごとの交点の偶奇の多数決で内部のセルを求める
+  //
+  void fillParity( ThreadPool& pool ) {
+    std::vector<unsigned char> votes( labels_.size(), 0 );
+    int n[3] = { nx_, ny_, nz_ };
+    for ( int a = 0; a < 3; ++a ) {
+      int b = ( a + 1 ) % 3, c = ( a + 2 ) % 3;
+      Eigen::Vector3d d = Eigen::Vector3d::Zero();
+      d[a] = 1.0;
+      parallelFor( pool, 0, n[b] * n[c], 16, [&]( int r ) {
+          int ic[3];
+          ic[b] = r % n[b];
+          ic[c] = r / n[b];
+          // グリッドの端 (外周の外部のセル) から列に沿って全ての交点を集める
+          Eigen::Vector3d o = origin_ + h_ * Eigen::Vector3d( 0.5, 0.5, 0.5 );
+          o[a] = origin_[a];
+          std::vector<double> ts;
+          double len = n[a] * h_, eps = 1.0e-9 * h_, t0 = .0;
+          while ( t0 < len ) {
+            Eigen::Vector3d s = o;
+            s[b] += ic[b] * h_;
+            s[c] += ic[c] * h_;
+            s[a] += t0;
+            RayHit hit = octree_->raycast( s, d, len - t0 );
+            if ( !hit.isHit() ) break;
+            ts.push_back( t0 + hit.t );
+            t0 += hit.t + eps;
+          }
+          // セルの中心より手前の交点が奇数個なら内部
+          int m = 0;
+          for ( ic[a] = 0; ic[a] < n[a]; ++ic[a] ) {
+            double tc = ( ic[a] + 0.5 ) * h_;
+            while ( ( m < ts.size() ) && ( ts[m] < tc ) ) ++m;
+            if ( m & 1 ) ++votes[ index( ic[0], ic[1], ic[2] ) ];
+          }
+        } );
+    }
+
+    for ( size_t id = 0; id < labels_.size(); ++id )
+      if ( labels_[id] != SURFACE ) labels_[id] = ( votes[id] >= 2 ) ? INSIDE : OUTSIDE;
+  };
+
+  //
+  // 表面のセル c にある点 p の内外判定
+  // 近くの表面でないセルの中心 q までの線分がメッシュと交わる回数が偶数なら q と同じ側
+  //
+  bool resolveSurface( const Eigen::Vector3d& p, const int c[3] ) {
+    for ( int r = 1; r <= 2; ++r )
+      for ( int dk = -r; dk <= r; ++dk )
+        for ( int dj = -r; dj <= r; ++dj )
+          for ( int di = -r; di <= r; ++di ) {
+            // 半径 r の立方体の表面のセルのみ
+            if ( std::max( std::abs( di ), std::max( std::abs( dj ), std::abs( dk ) ) ) != r ) continue;
+            int i = c[0] + di, j = c[1] + dj, k = c[2] + dk;
+            if ( ( i < 0 ) || ( j < 0 ) || ( k < 0 ) || ( i >= nx_ ) || ( j >= ny_ ) || ( k >= nz_ ) ) continue;
+            int l = label( i, j, k );
+            if ( l == SURFACE ) continue;
+            Eigen::Vector3d q = origin_ + h_ * Eigen::Vector3d( i + 0.5, j + 0.5, k + 0.5 );
+            bool odd = ( countCrossings( p, q ) & 1 ) ? true : false;
+            return ( ( l == INSIDE ) != odd ) ? true : false;
+          }
+    // 周りがすべて表面のセル (薄い部分) なら内部とみなす
+    return true;
+  };
+
+  // 線分 pq とメッシュとの交点の数
+  int countCrossings( const Eigen::Vector3d& p, const Eigen::Vector3d& q ) {
+    Eigen::Vector3d d = q - p;
+    double len = d.norm();
+    if ( len <= .0 ) return 0;
+    d /= len;
+    double eps = 1.0e-9 * h_;
+    Eigen::Vector3d o = p;
+    int n = 0;
+    while ( len > .0 ) {
+      RayHit hit = octree_->raycast( o, d, len );
+      if ( !hit.isHit() ) break;
+      ++n;
+      double step = hit.t + eps;
+      o += step * d;
+      len -= step;
+    }
+    return n;
+  };
+
+  static void collectLeaves( Octree* node, std::vector<Octree*>& leaves ) {
+    if ( node == NULL ) return;
+    if ( node->tris_size() ) leaves.push_back( node );
+    for ( int i = 0; i < 8; ++i ) collectLeaves( node->child( i ), leaves );
+  };
+
+  int dim( int j ) const { return ( j == 0 ) ? nx_ : ( ( j == 1 ) ? ny_ : nz_ ); };
+
+  Octree* octree_;
+  int fill_mode_;
+  int nx_, ny_, nz_;
+  Eigen::Vector3d origin_;
+  double h_;
+  std::vector<unsigned char> labels_;
+};
+
+#endif // _OCTREEVOXEL_HXX
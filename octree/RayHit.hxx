@@ -0,0 +1,45 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: RayHit.hxx 2026/10/18 10:40:05 kanai Exp $
+//
+// Copyright (c) 2026 by Takashi Kanai. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef _RAYHIT_HXX
+#define _RAYHIT_HXX 1
+
+#include <limits>
+using namespace std;
+
+#include "myEigen.hxx"
+#include "FaceL.hxx"
+
+//
+// レイと面の交差結果
+// - 交点は origin + t * dir = (1-u-v) * p0 + u * p1 + v * p2
+//
+struct RayHit {
+  FaceL* face;   // 交差した面 (交差しなければ NULL)
+  double t;      // レイのパラメータ
+  double u, v;   // 重心座標
+
+  RayHit() : face(NULL), t(std::numeric_limits<double>::max()), u(.0), v(.0) {};
+  bool isHit() const { return ( face != NULL ) ? true : false; };
+};
+
+//
+// 点に最も近いメッシュ上の点の探索結果
+//
+struct ClosestHit {
+  FaceL* face;             // 最近点を含む面 (見つからなければ NULL)
+  Eigen::Vector3d point;   // 最近点
+  double distance;         // 最近点までの距離
+  double bc[3];            // 最近点の面内の重心座標
+
+  ClosestHit() : face(NULL), point(Eigen::Vector3d::Zero()),
+                 distance(std::numeric_limits<double>::max()) { bc[0] = bc[1] = bc[2] = .0; };
+  bool isHit() const { return ( face != NULL ) ? true : false; };
+};
+
+#endif // _RAYHIT_HXX
@@ -0,0 +1,180 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: RayPacket.hxx 2026/10/18 10:42:17 kanai Exp $
+//
+// Copyright (c) 2026 by Takashi Kanai. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef _RAYPACKET_HXX
+#define _RAYPACKET_HXX 1
+
+#include <limits>
+#include <algorithm>
+using namespace std;
+
+#include "myEigen.hxx"
+#include "FaceL.hxx"
+#include "RayHit.hxx"
+
+//
+// レーンの演算が 256 bit のベクトル命令 (AVX2) になるときだけ 1
+// - SSE2 だけではパケットはスカラーの raycast() より速くならないので，
+//   Octree::raycastBatch() はこれが 0 ならパケットを使わない
+// - CMake の OCTREE_AVX2 (VC では msbuild /p:OctreeAVX2=true) で有効にする
+//
+#if defined( __AVX2__ )
+#define RAYPACKET_SIMD 1
+#else
+#define RAYPACKET_SIMD 0
+#endif
+
+//
+// K 本のレイをまとめて扱うレイパケット
+// - 各成分をレーンごとの配列 (SoA) で持つ
+// - レーンの有効/無効はビットマスク (unsigned int) で表す
+// - 演算はレーン方向の単純なループで書いてあり，
+//   コンパイラが SSE/AVX 命令にベクトル化する
+//
+template <int K>
+struct RayPacket {
+
+  // 始点，方向，方向の逆数
+  double ox[K], oy[K], oz[K];
+  double dx[K], dy[K], dz[K];
+  double ix[K], iy[K], iz[K];
+
+  // 交差結果 (t は探索範囲の上限も兼ねる)
+  double t[K], u[K], v[K];
+  FaceL* face[K];
+
+  RayPacket() {
+    for ( int i = 0; i < K; ++i ) {
+      set( i, Eigen::Vector3d::Zero(), Eigen::Vector3d::UnitZ() );
+    }
+  };
+
+  static int size() { return K; };
+  static unsigned int fullMask() { return ( K == 32 ) ? ~0u : ( (1u << K) - 1u ); };
+
+  // レーン i にレイ origin + t * dir (0 <= t <= tmax) をセット
+  void set( int i, const Eigen::Vector3d& origin, const Eigen::Vector3d& dir,
+            double tmax = std::numeric_limits<double>::max() ) {
+    ox[i] = origin.x(); oy[i] = origin.y(); oz[i] = origin.z();
+    dx[i] = dir.x();    dy[i] = dir.y();    dz[i] = dir.z();
+    ix[i] = 1.0 / dir.x(); iy[i] = 1.0 / dir.y(); iz[i] = 1.0 / dir.z();
+    t[i] = tmax;
+    u[i] = v[i] = .0;
+    face[i] = NULL;
+  };
+
+  Eigen::Vector3d origin( int i ) const { return Eigen::Vector3d( ox[i], oy[i], oz[i] ); };
+  Eigen::Vector3d dir( int i ) const { return Eigen::Vector3d( dx[i], dy[i], dz[i] ); };
+
+  // レーン i の交差結果
+  RayHit hit( int i ) const {
+    RayHit h;
+    if ( face[i] != NULL ) {
+      h.face = face[i];
+      h.t = t[i];
+      h.u = u[i];
+      h.v = v[i];
+    }
+    return h;
+  };
+
+  //
+  // 全レーンの方向の符号が一致していれば，その符号 (bit0: x, bit1: y, bit2: z が負)
+  // を返す．一致していなければ -1
+  //
+  int signOctant() const {
+    int s = dirSign( 0 );
+    for ( int i = 1; i < K; ++i ) if ( dirSign( i ) != s ) return -1;
+    return s;
+  };
+
+  int dirSign( int i ) const {
+    return ( (dx[i] < .0) ? 1 : 0 ) | ( (dy[i] < .0) ? 2 : 0 ) | ( (dz[i] < .0) ? 4 : 0 );
+  };
+
+  //
+  // ボックス [bbmin, bbmax] と交差するレーンのマスクを返す
+  // - 探索範囲は各レーンの [0, t]
+  //
+  unsigned int intersectBox( const Eigen::Vector3d& bbmin, const Eigen::Vector3d& bbmax,
+                             unsigned int mask ) const {
+    const double x0 = bbmin.x(), y0 = bbmin.y(), z0 = bbmin.z();
+    const double x1 = bbmax.x(), y1 = bbmax.y(), z1 = bbmax.z();
+    int in[K];
+    for ( int i = 0; i < K; ++i ) {
+      double tx1 = (x0 - ox[i]) * ix[i], tx2 = (x1 - ox[i]) * ix[i];
+      double ty1 = (y0 - oy[i]) * iy[i], ty2 = (y1 - oy[i]) * iy[i];
+      double tz1 = (z0 - oz[i]) * iz[i], tz2 = (z1 - oz[i]) * iz[i];
+      double t_near = std::max( std::max( .0, std::min( tx1, tx2 ) ),
+                                std::max( std::min( ty1, ty2 ), std::min( tz1, tz2 ) ) );
+      double t_far  = std::min( std::min( t[i], std::max( tx1, tx2 ) ),
+                                std::min( std::max( ty1, ty2 ), std::max( tz1, tz2 ) ) );
+      in[i] = ( t_near <= t_far );
+    }
+
+    unsigned int hit = 0;
+    for ( int i = 0; i < K; ++i ) hit |= ( (unsigned int) in[i] << i );
+    return hit & mask;
+  };
+
+  //
+  // 三角形 (v0, v0+e1, v0+e2) との交差判定 (Moller-Trumbore)
+  // - mask のレーンのうち，より近い交点を持つものの t, u, v, face を更新する
+  // - 更新したレーンのマスクを返す
+  //
+  unsigned int intersectTriangle( const double v0[3], const double e1[3], const double e2[3],
+                                  FaceL* fc, unsigned int mask ) {
+    // 平行とみなす行列式の閾値 (スカラー版 raytri.c の EPSILON と同じにして結果をそろえる)
+    const double eps = 0.000001;
+    const double v0x = v0[0], v0y = v0[1], v0z = v0[2];
+    const double e1x = e1[0], e1y = e1[1], e1z = e1[2];
+    const double e2x = e2[0], e2y = e2[1], e2z = e2[2];
+    double tt[K], uu[K], vv[K];
+    int ok[K];
+    for ( int i = 0; i < K; ++i ) {
+      // pvec = dir x e2
+      double px = dy[i] * e2z - dz[i] * e2y;
+      double py = dz[i] * e2x - dx[i] * e2z;
+      double pz = dx[i] * e2y - dy[i] * e2x;
+      double det = e1x * px + e1y * py + e1z * pz;
+      double inv_det = 1.0 / det;
+
+      // tvec = orig - v0
+      double sx = ox[i] - v0x, sy = oy[i] - v0y, sz = oz[i] - v0z;
+      uu[i] = (sx * px + sy * py + sz * pz) * inv_det;
+
+      // qvec = tvec x e1
+      double qx = sy * e1z - sz * e1y;
+      double qy = sz * e1x - sx * e1z;
+      double qz = sx * e1y - sy * e1x;
+      vv[i] = (dx[i] * qx + dy[i] * qy + dz[i] * qz) * inv_det;
+      tt[i] = (e2x * qx + e2y * qy + e2z * qz) * inv_det;
+
+      // 分岐させずにビット演算でまとめる
+      ok[i] = ( ( det > eps ) | ( det < -eps ) ) & ( uu[i] >= .0 ) & ( vv[i] >= .0 )
+        & ( uu[i] + vv[i] <= 1.0 ) & ( tt[i] >= .0 ) & ( tt[i] < t[i] );
+    }
+
+    unsigned int hit = 0;
+    for ( int i = 0; i < K; ++i ) {
+      if ( !( (mask >> i) & 1u & (unsigned int) ok[i] ) ) continue;
+      t[i] = tt[i];
+      u[i] = uu[i];
+      v[i] = vv[i];
+      face[i] = fc;
+      hit |= (1u << i);
+    }
+    return hit;
+  };
+
+};
+
+typedef RayPacket<4> RayPacket4;
+typedef RayPacket<8> RayPacket8;
+
+#endif // _RAYPACKET_HXX
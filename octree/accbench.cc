@@ -0,0 +1,159 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: accbench.cc 2026/10/18 14:40:52 kanai Exp $
+//
+// Octree と BVH の構築・問い合わせ時間の比較
+//
+// usage: accbench [mesh.obj ...]
+//
+// Copyright (c) 2026 by Takashi Kanai. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////
+
+#include "envDep.h"
+#include "mydef.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+using namespace std;
+
+#include "MeshL.hxx"
+#include "SMFLIO.hxx"
+
+#include "Octree.hxx"
+#include "BVH.hxx"
+
+static double elapsed( std::chrono::steady_clock::time_point t0 ) {
+  return std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+}
+
+//
+// 問い合わせの集合
+// - camera: メッシュの前方から z 方向に飛ばす 512x512 本のレイ
+// - random: バウンディングボックス内の点からランダムな方向に飛ばすレイ
+// - points: バウンディングボックスを少し広げた範囲のランダムな点 (最近点)
+//
+struct Queries {
+  std::vector<Eigen::Vector3d> cam_o, cam_d;
+  std::vector<Eigen::Vector3d> rnd_o, rnd_d;
+  std::vector<Eigen::Vector3d> points;
+
+  void make( const Eigen::Vector3d& bbmin, const Eigen::Vector3d& bbmax ) {
+    Eigen::Vector3d c = ( bbmin + bbmax ) * 0.5, h = bbmax - bbmin;
+    const int res = 512;
+    for ( int j = 0; j < res; ++j )
+      for ( int i = 0; i < res; ++i ) {
+        double x = bbmin.x() + h.x() * ( i + 0.5 ) / res;
+        double y = bbmin.y() + h.y() * ( j + 0.5 ) / res;
+        cam_o.push_back( Eigen::Vector3d( x, y, bbmax.z() + h.norm() ) );
+        cam_d.push_back( Eigen::Vector3d( 0, 0, -1.0 ) );
+      }
+
+    std::mt19937 gen( 1 );
+    std::uniform_real_distribution<double> uni( -0.5, 0.5 );
+    std::normal_distribution<double> nrm;
+    for ( int i = 0; i < 200000; ++i ) {
+      rnd_o.push_back( c + Eigen::Vector3d( uni( gen ) * h.x(), uni( gen ) * h.y(), uni( gen ) * h.z() ) );
+      rnd_d.push_back( Eigen::Vector3d( nrm( gen ), nrm( gen ), nrm( gen ) ).normalized() );
+    }
+    for ( int i = 0; i < 50000; ++i )
+      points.push_back( c + 1.2 * Eigen::Vector3d( uni( gen ) * h.x(), uni( gen ) * h.y(), uni( gen ) * h.z() ) );
+  };
+};
+
+struct Result {
+  double raycast_cam, raycast_rnd, anyhit, closest;
+  std::vector<RayHit> hits;
+  std::vector<char> occluded;
+  std::vector<ClosestHit> chits;
+};
+
+static void runQueries( Accelerator& acc, Queries& q, Result& r ) {
+  std::vector<RayHit> cam_hits;
+  auto t0 = std::chrono::steady_clock::now();
+  acc.raycastBatch( q.cam_o, q.cam_d, cam_hits );
+  r.raycast_cam = elapsed( t0 );
+
+  t0 = std::chrono::steady_clock::now();
+  acc.raycastBatch( q.rnd_o, q.rnd_d, r.hits );
+  r.raycast_rnd = elapsed( t0 );
+
+  t0 = std::chrono::steady_clock::now();
+  acc.anyHitBatch( q.rnd_o, q.rnd_d, r.occluded );
+  r.anyhit = elapsed( t0 );
+
+  t0 = std::chrono::steady_clock::now();
+  acc.closestPointBatch( q.points, r.chits );
+  r.closest = elapsed( t0 );
+}
+
+int main( int argc, char* argv[] ) {
+  std::vector<std::string> files;
+  for ( int i = 1; i < argc; ++i ) files.push_back( argv[i] );
+  if ( files.empty() ) {
+    files.push_back( "../data/bunny.obj" );
+    files.push_back( "../data/fandisk.obj" );
+    files.push_back( "../data/mechpart.obj" );
+  }
+
+  std::cout << "threads: " << ThreadPool::instance().size() << std::endl;
+  printf( "%-20s %-6s %8s %9s %9s %9s %9s\n",
+          "mesh", "accel", "build", "ray(cam)", "ray(rnd)", "anyhit", "closest" );
+
+  for ( auto& file : files ) {
+    MeshL mesh;
+    SMFLIO io;
+    io.setMesh( mesh );
+    if ( !io.inputFromFile( file.c_str() ) ) {
+      std::cerr << "cannot open " << file << std::endl;
+      continue;
+    }
+
+    Eigen::Vector3d bbmin, bbmax;
+    mesh.computeBB( bbmin, bbmax );
+    std::vector<FaceL*> faces( mesh.faces().begin(), mesh.faces().end() );
+
+    Queries q;
+    q.make( bbmin, bbmax );
+
+    Octree octree;
+    auto t0 = std::chrono::steady_clock::now();
+    octree.setBB( bbmin, bbmax );
+    octree.build( faces );
+    double t_oct = elapsed( t0 );
+
+    BVH bvh;
+    t0 = std::chrono::steady_clock::now();
+    bvh.build( faces );
+    double t_bvh = elapsed( t0 );
+
+    Result ro, rb;
+    runQueries( octree, q, ro );
+    runQueries( bvh, q, rb );
+
+    std::string name = file.substr( file.find_last_of( "/\\" ) + 1 );
+    printf( "%-20s %-6s %8.4f %9.4f %9.4f %9.4f %9.4f\n", name.c_str(), octree.name(),
+            t_oct, ro.raycast_cam, ro.raycast_rnd, ro.anyhit, ro.closest );
+    printf( "%-20s %-6s %8.4f %9.4f %9.4f %9.4f %9.4f\n", "", bvh.name(),
+            t_bvh, rb.raycast_cam, rb.raycast_rnd, rb.anyhit, rb.closest );
+
+    // 結果が一致するか (距離の差のみ比べる．同じ距離の面はどちらを返してもよい)
+    int n_diff = 0;
+    for ( int i = 0; i < ro.hits.size(); ++i ) {
+      if ( ro.hits[i].isHit() != rb.hits[i].isHit() ) ++n_diff;
+      else if ( ro.hits[i].isHit() && std::fabs( ro.hits[i].t - rb.hits[i].t ) > 1.0e-9 ) ++n_diff;
+      if ( ro.occluded[i] != rb.occluded[i] ) ++n_diff;
+    }
+    for ( int i = 0; i < ro.chits.size(); ++i )
+      if ( std::fabs( ro.chits[i].distance - rb.chits[i].distance ) > 1.0e-9 ) ++n_diff;
+    if ( n_diff ) std::cout << "  mismatches: " << n_diff << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -13,6 +13,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <chrono>
+#include <string>
 using namespace std;
 
 #include <GL/glew.h>
@@ -28,9 +29,11 @@ MeshL mesh;
 SMFLIO smflio;
 
 #include "Octree.hxx"
+#include "OctreeCache.hxx"
 #include "GLOctree.hxx"
 
-Octree octree;
+// 構築済みの octree は in.obj.octc にキャッシュし，2 回目以降はマップして使う
+OctreeCache octree;
 GLOctree gloctree;
 
 // ray の始点
@@ -44,11 +47,20 @@ Eigen::Vector3d np;
 int nfid = -1;
 
 #include "GLMeshL.hxx"
+#include "GLMeshR.hxx"
 #include "GLPanel.hxx"
 
 GLPanel pane;
 GLMeshL glmeshl;
 
+// アンビエントオクルージョンの表示用
+#include "OctreeAO.hxx"
+
+OctreeAO octreeAO;
+MeshR meshr;
+GLMeshR glmeshr;
+bool isDrawAO = false;
+
 ////////////////////////////////////////////////////////////////////////////////////
 
 // keyboard
@@ -91,6 +103,23 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
     return;
   }
 
+  // a: 頂点ごとの AO の表示切り替え (初回に計算)
+  else if ((key == GLFW_KEY_A) && (action == GLFW_PRESS)) {
+    if (meshr.empty()) {
+      std::vector<double> ao;
+      auto t0 = std::chrono::system_clock::now();
+      octreeAO.calcVertexAO(octree, mesh, ao);
+      auto t1 = std::chrono::system_clock::now();
+      std::cout << "AO: " << mesh.vertices_size() * octreeAO.numRays() << " rays, "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count()
+                << " ms." << std::endl;
+      octreeAO.setMeshR(mesh, ao, meshr);
+      glmeshr.setMesh(meshr);
+    }
+    isDrawAO = !isDrawAO;
+    return;
+  }
+
   // shift
   else if ((key == GLFW_KEY_LEFT_SHIFT) && (action == GLFW_PRESS)) {
     shift_key_pressed = true;
@@ -172,18 +201,31 @@ int main(int argc, char** argv) {
   }
 
   //
-  // ここから
   // mesh の Bounding Box を計算
+  Eigen::Vector3d bbmin, bbmax;
+  mesh.computeBB( bbmin, bbmax );
 
   // octree の構築
-  // 面を格納 （addFaceToOctree を利用）
+  // 面をまとめて格納 （Octree::build を利用．addFaceToOctree で 1 枚ずつ入れても同じ木になる）
+  // キャッシュファイルがあり，メッシュが変わっていなければ構築せずにそれを使う
+  std::string cachefile = std::string( argv[1] ) + ".octc";
+  auto t0 = std::chrono::system_clock::now();
+  bool cached = octree.openOrBuild( cachefile.c_str(), mesh.faces(), bbmin, bbmax );
+  auto t1 = std::chrono::system_clock::now();
+  std::cout << "octree: " << ( cached ? "loaded " : "built " ) << cachefile << " "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count()
+            << " ms." << std::endl;
 
   // Octree を利用
   // 点 pos を通り，方向 dir のレイとメッシュの交点のうち，pos に一番近い点 np を取得
   // なければ nfid = -1
-  // 関数を別途作成して呼び出す
+  RayHit hit = octree.raycast( pos, dir );
+  if ( hit.isHit() ) {
+    np = pos + hit.t * dir;
+    nfid = hit.face->id();
+  }
+  std::cout << "ray hit: face " << nfid << std::endl;
 
-  // ここまで
   //
   // 表示用設定 （ここから先は特に触らなくても良い）
   //
@@ -219,8 +261,11 @@ int main(int argc, char** argv) {
     pane.setView();
     pane.setLight();
 
-    glmeshl.draw();
-    gloctree.drawOctree( &octree );
+    if (isDrawAO)
+      glmeshr.draw();
+    else
+      glmeshl.draw();
+    gloctree.drawOctree( octree );
 
     // intersection point
     ::glPointSize( 5.0f );
@@ -219,6 +219,66 @@ int intersect_triangle2(double orig[3], double dir[3],
    return 1;
 }
 
+/* same as intersect_triangle2(), but takes the precomputed edges
+   edge1 = vert1 - vert0, edge2 = vert2 - vert0 */
+int intersect_triangle2_edge(double orig[3], double dir[3],
+			     const double vert0[3], const double edge1[3], const double edge2[3],
+			     double *t, double *u, double *v)
+{
+   double tvec[3], pvec[3], qvec[3];
+   double det,inv_det;
+
+   /* begin calculating determinant - also used to calculate U parameter */
+   CROSS(pvec, dir, edge2);
+
+   /* if determinant is near zero, ray lies in plane of triangle */
+   det = DOT(edge1, pvec);
+
+   /* calculate distance from vert0 to ray origin */
+   SUB(tvec, orig, vert0);
+   inv_det = 1.0 / det;
+
+   if (det > EPSILON)
+   {
+      /* calculate U parameter and test bounds */
+      *u = DOT(tvec, pvec);
+      if (*u < 0.0 || *u > det)
+	 return 0;
+
+      /* prepare to test V parameter */
+      CROSS(qvec, tvec, edge1);
+
+      /* calculate V parameter and test bounds */
+      *v = DOT(dir, qvec);
+      if (*v < 0.0 || *u + *v > det)
+	 return 0;
+
+   }
+   else if(det < -EPSILON)
+   {
+      /* calculate U parameter and test bounds */
+      *u = DOT(tvec, pvec);
+      if (*u > 0.0 || *u < det)
+	 return 0;
+
+      /* prepare to test V parameter */
+      CROSS(qvec, tvec, edge1);
+
+      /* calculate V parameter and test bounds */
+      *v = DOT(dir, qvec) ;
+      if (*v > 0.0 || *u + *v < det)
+	 return 0;
+   }
+   else return 0;  /* ray is parallell to the plane of the triangle */
+
+   /* calculate t, ray intersects triangle */
+   *t = DOT(edge2, qvec) * inv_det;
+   (*u) *= inv_det;
+   (*v) *= inv_det;
+
+   return 1;
+}
+
 /* code rewritten to do tests on the sign of the determinant */
 /* the division is before the test of the sign of the det    */
 /* and one CROSS has been moved out from the if-else if-else */
@@ -15,6 +15,9 @@ extern "C" {
   extern int intersect_triangle2(double orig[3], double dir[3],
 				double vert0[3], double vert1[3], double vert2[3],
 				double *t, double *u, double *v);
+  extern int intersect_triangle2_edge(double orig[3], double dir[3],
+				     const double vert0[3], const double edge1[3], const double edge2[3],
+				     double *t, double *u, double *v);
   extern int intersect_triangle3(double orig[3], double dir[3],
 				double vert0[3], double vert1[3], double vert2[3],
 				double *t, double *u, double *v);
@@ -0,0 +1,19 @@
+#ifndef _TRITRI_H
+#define _TRITRI_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // tritri.c に定義されている関数を利用
+  extern int NoDivTriTriIsect(const double V0[3], const double V1[3], const double V2[3],
+			      const double U0[3], const double U1[3], const double U2[3]);
+  extern int coplanar_tri_tri(const double N[3],
+			      const double V0[3], const double V1[3], const double V2[3],
+			      const double U0[3], const double U1[3], const double U2[3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _TRITRI_H
@@ -16,12 +16,11 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <sstream>
+#include <string_view>
 using namespace std;
 
 #include "timer.hxx"
-#include "strutil.h"
-#include "tokenizer.h"
+#include "OBJScanner.hxx"
 
 #include "MeshR.hxx"
 #include "RIO.hxx"
@@ -34,14 +33,18 @@ public:
   OBJRIO( MeshR& mesh ) : RIO( mesh ) {};
   ~OBJRIO() {};
   
+  //
+  // OBJ (SMF) ファイルの読み込み
+  // - ファイルをメモリにマップし (OBJScanner)，行頭の語だけを見て要素の数を数えてから
+  //   配列を確保し，もう一度バイト列を走査して数値を std::from_chars で直接読み込む
+  //   (ファイルを開き直したり行ごとに文字列を作ったりしない)
+  //
   bool inputFromFile( const char* const filename ) {
     //
     // file open
     //
-
-    // 1st try
-    std::ifstream ifs0; ifs0.open( filename );
-    if ( !ifs0.is_open() )
+    OBJScanner scanner;
+    if ( !scanner.open( filename ) )
       {
         std::cerr << "Cannot open " << filename << std::endl;
         return false;
@@ -60,34 +63,24 @@ public:
 
     std::cout << "count elements ..." << std::endl;
 
-    std::string cline;
-    StrUtil strutil;
-    while ( getline(ifs0, cline, '\n') )
-      {
-	std::string fw;
-	strutil.first_word( cline, fw );
-
-	// comment
-	if ( mycomment(cline[0]) ) continue;
+    scanner.forEachLine( [&]( OBJLine& line ) {
+	std::string_view fw = line.word();
 
-	else if ( !fw.compare("v") ) ++v_count;
-	else if ( !fw.compare("n") || !fw.compare("vn") ) ++n_count;
-	else if ( !fw.compare("r") ) 
+	if ( fw == "v" ) ++v_count;
+	else if ( ( fw == "n" ) || ( fw == "vn" ) ) ++n_count;
+	else if ( fw == "r" )
 	  {
 	    if ( !r_count )
 	      {
-		int wc = strutil.word_count( cline );
-		if ( wc == 3 ) mesh().setNTex( 2 );
+		if ( line.wordCount() == 2 ) mesh().setNTex( 2 );
 		else mesh().setNTex( 3 );
 	      }
 	    ++r_count;
 	  }
-	else if ( !fw.compare("c") ) ++c_count;
-	else if ( !fw.compare("cf") ) ++cf_count;
-	else if ( !fw.compare("f") ) ++f_count;
-      }
-
-    ifs0.close();
+	else if ( fw == "c" ) ++c_count;
+	else if ( fw == "cf" ) ++cf_count;
+	else if ( fw == "f" ) ++f_count;
+      } );
 
     std::cout << "done." << endl;
 
@@ -110,15 +103,6 @@ public:
     if ( f_count )  mesh().reserveIndices(   f_count );
     if ( n_count && f_count )  mesh().reserveNIndices(   f_count );
 
-  
-    // 2nd try
-    std::ifstream ifs; ifs.open( filename );
-    if ( !ifs.is_open() )
-      {
-	std::cerr << "Cannot open " << filename << std::endl;
-	return false;
-      }
-
     //
     // parse smf
     //
@@ -130,195 +114,100 @@ public:
     int f_id = 0;
     Timer t;
     double time0 = t.get_seconds();
-    while ( getline(ifs, cline, '\n') )
-      {
-	std::string fw;
-	strutil.first_word( cline, fw );
-      
-	// comment
-	if ( mycomment(cline[0]) ) continue;
+    scanner.forEachLine( [&]( OBJLine& line ) {
+	std::string_view fw = line.word();
 
 	// read vertices
-	else if ( !fw.compare("v") )
+	if ( fw == "v" )
 	  {
-#if 0
-	    std::istringstream isstr( cline );
-
-	    // "v"
-	    std::string str; isstr >> str;
-
-	    float x, y, z;
-	    isstr >> x; isstr >> y; isstr >> z;
-#endif
-
-#if 1
-	    char dummy[BUFSIZ];
-	    char xc[BUFSIZ], yc[BUFSIZ], zc[BUFSIZ];
-	    sscanf( cline.c_str(), "%s%s%s%s", &dummy, &xc, &yc, &zc );
-	    float x = atof( xc );
-	    float y = atof( yc );
-	    float z = atof( zc );
-#endif
-
-            //            cout << v_id/3 << " " << x << " " << y << " " << z << endl;
+	    float x = 0.0f, y = 0.0f, z = 0.0f;
+	    line.number( x ); line.number( y ); line.number( z );
 	    mesh().setPoint( v_id, x, y, z );
 	    v_id += nXYZ;
 	  }
 
 	// read normals
-	else if ( !fw.compare("n") || !fw.compare("vn") )
+	else if ( ( fw == "n" ) || ( fw == "vn" ) )
 	  {
-#if 0
-	    std::istringstream isstr( cline );
-	  
-	    // "n"
-	    std::string str; isstr >> str;
-
-	    float x, y, z;
-	    isstr >> x; isstr >> y; isstr >> z;
-#endif
-
-#if 1
-	    char dummy[BUFSIZ];
-	    char xc[BUFSIZ], yc[BUFSIZ], zc[BUFSIZ];
-	    sscanf( cline.c_str(), "%s%s%s%s", &dummy, &xc, &yc, &zc );
-	    float x = atof( xc );
-	    float y = atof( yc );
-	    float z = atof( zc );
-            //            cout << x << " " << y << " " << z << endl;
-#endif
-
+	    float x = 0.0f, y = 0.0f, z = 0.0f;
+	    line.number( x ); line.number( y ); line.number( z );
 	    mesh().setNormal( n_id, x, y, z );
 	    n_id += nXYZ;
 	  }
 
 	// read texcoords
-	else if ( !fw.compare("r") )
+	else if ( fw == "r" )
 	  {
-	    char dummy[BUFSIZ];
-	    char xc[BUFSIZ], yc[BUFSIZ], zc[BUFSIZ];
-	    float x, y, z;
+	    float x = 0.0f, y = 0.0f, z = 0.0f;
+	    line.number( x ); line.number( y );
 	    if ( mesh().n_tex() == 2 )
 	      {
-		sscanf( cline.c_str(), "%s%s%s", &dummy, &xc, &yc );
-		x = atof( xc );
-		y = atof( yc );
 		mesh().setTexcoord( r_id, x, y );
 	      }
 	    else if ( mesh().n_tex() == 3 )
 	      {
-		sscanf( cline.c_str(), "%s%s%s%s", &dummy, &xc, &yc, &zc );
-		x = atof( xc );
-		y = atof( yc );
-		z = atof( zc );
+		line.number( z );
 		mesh().setTexcoord( r_id, x, y, z );
 	      }
 	    r_id += mesh().n_tex();
 	  }
 
 	// binding types
-	else if ( !fw.compare("bind") )
+	else if ( fw == "bind" )
 	  {
-	    std::string s;
-	    strutil.nth_word( cline, 3, s );
-	    if ( !s.compare("vertex") )
+	    line.word();
+	    std::string_view s = line.word();
+	    if ( s == "vertex" )
 	      mesh().setColorAssigned( ASSIGN_VERTEX );
-	    else if ( !s.compare("face") )
+	    else if ( s == "face" )
 	      mesh().setColorAssigned( ASSIGN_FACE );
 	  }
 
 	// colors
-	else if ( !fw.compare("c") )
+	else if ( fw == "c" )
 	  {
-	    char dummy[BUFSIZ];
-	    char xc[BUFSIZ], yc[BUFSIZ], zc[BUFSIZ];
-	    sscanf( cline.c_str(), "%s%s%s%s", &dummy, &xc, &yc, &zc );
-	    float x = atof( xc );
-	    float y = atof( yc );
-	    float z = atof( zc );
-
+	    float x = 0.0f, y = 0.0f, z = 0.0f;
+	    line.number( x ); line.number( y ); line.number( z );
 	    mesh().setColor( c_id, x, y, z );
 	    c_id += nXYZ;
 	  }
 
 	// face color ids
-	else if ( !fw.compare("cf") )
+	else if ( fw == "cf" )
 	  {
-	    char dummy[BUFSIZ];
-	    char ids[BUFSIZ];
-	    sscanf( cline.c_str(), "%s%s", &dummy, &ids );
-	    unsigned int id = atoi( ids );
-
+	    int id = 0;
+	    line.number( id );
 	    mesh().setColorId( cf_id, id );
 	    ++ cf_id;
 	  }
-      
-	// read faces
-	else if ( !fw.compare("f") )
+
+	// read faces (三角形．角は "頂点" か "頂点/法線" または "頂点//法線")
+	else if ( fw == "f" )
 	  {
-	    if ( cline.find("/") != std::string::npos )
-	      {
-		std::istringstream isstr( cline );
-
-		// "f"
-		std::string str; isstr >> str;
-
-		int j = 0;
-		while ( isstr >> str )
-		  {
-		    if ( j >= 3 ) break;
-		    tokenizer tok( str, "//" );
-		  
-		    // vertex
-		    std::string val = tok.next();
-
-		    int id0;
-		    unsigned int id;
-		    std::istringstream ai(val); ai >> id0;
-		    id = id0 - 1;
-		    mesh().setIndex( f_id, id );
-		    // 		  cout << id << " ";
-	      
-		    // normal
-		    if ( n_count )
-		      {
-			val = tok.next();
-			int id1;
-			std::istringstream ai(val); ai >> id1;
-			id = id1 - 1;
-			mesh().setNIndex( f_id, id );
-			// 		      cout << id << " ";
-		      }
-	      
-		    ++f_id;
-		    ++j;
-		  }
-		// 	      cout << endl;
-	      }
-	    else
+	    int ids[3];
+	    for ( int j = 0; j < TRIANGLE; ++j )
 	      {
-		char dummy[BUFSIZ];
-		char xc[BUFSIZ], yc[BUFSIZ], zc[BUFSIZ];
-		sscanf( cline.c_str(), "%s%s%s%s", &dummy, &xc, &yc, &zc );
-		unsigned int id0 = atoi( xc ) - 1;
-		unsigned int id1 = atoi( yc ) - 1;
-		unsigned int id2 = atoi( zc ) - 1;
-		mesh().setIndex( f_id, id0 ); ++f_id;
-		mesh().setIndex( f_id, id1 ); ++f_id;
-		mesh().setIndex( f_id, id2 ); ++f_id;
+		int n = line.corner( ids );
+		if ( !n ) break;
+
+		// vertex
+		mesh().setIndex( f_id, ids[0] - 1 );
+
+		// normal
+		if ( n_count && ( n > 1 ) ) mesh().setNIndex( f_id, ids[1] - 1 );
+
+		++f_id;
 	      }
-	  
 	  }
-      
-      } // while
-  
+      } );
+
     double time1 = t.get_seconds();
     std::cout << "done. ellapsed time: " << time1 - time0 << " sec. " << std::endl;
 
-    ifs.close();
+    scanner.close();
 
     mesh().printInfo();
-  
+
     return true;
   };
 
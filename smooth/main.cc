@@ -211,6 +211,8 @@ int main(int argc, char** argv) {
 
   // メッシュデータの読み込み
   smflio.setMesh(mesh);
+  // 面ごとに複製された頂点をまとめる (座標が一致する頂点)
+  smflio.setWeld(true);
   if (smflio.inputFromFile(argv[1]) == false) {
     return EXIT_FAILURE;
   }
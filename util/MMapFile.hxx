@@ -0,0 +1,122 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: MMapFile.hxx 2026/10/18 15:02:44 kanai Exp $
+//
+// read-only memory mapped file
+//
+// Copyright (c) 2026 Takashi Kanai
+// Released under the MIT license
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef _MMAPFILE_HXX
+#define _MMAPFILE_HXX 1
+
+#include <cstddef>
+
+#if defined(_WIN32)
+// std::min, std::max と衝突するマクロを定義させない
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//
+// ファイル全体を読み出し専用でメモリにマップする
+// - data() から size() バイトをそのまま参照できる (読み込み・コピーはしない)
+// - 実際のページの読み込みは参照したときに OS が行う
+// - 長さ 0 のファイルはマップできないので，マップせずに空 (size() == 0) として開く
+//
+class MMapFile {
+
+public:
+
+  MMapFile() : data_(NULL), size_(0)
+#if defined(_WIN32)
+             , file_(INVALID_HANDLE_VALUE), map_(NULL)
+#endif
+  {};
+  ~MMapFile() { close(); };
+
+  bool open( const char* filename ) {
+    close();
+#if defined(_WIN32)
+    file_ = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if ( file_ == INVALID_HANDLE_VALUE ) return false;
+    LARGE_INTEGER sz;
+    if ( !GetFileSizeEx( file_, &sz ) ) { close(); return false; }
+    if ( sz.QuadPart == 0 ) {
+      CloseHandle( file_ );
+      file_ = INVALID_HANDLE_VALUE;
+      data_ = empty();
+      return true;
+    }
+    map_ = CreateFileMappingA( file_, NULL, PAGE_READONLY, 0, 0, NULL );
+    if ( map_ == NULL ) { close(); return false; }
+    data_ = (const char*) MapViewOfFile( map_, FILE_MAP_READ, 0, 0, 0 );
+    if ( data_ == NULL ) { close(); return false; }
+    size_ = (size_t) sz.QuadPart;
+#else
+    int fd = ::open( filename, O_RDONLY );
+    if ( fd < 0 ) return false;
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 ) { ::close( fd ); return false; }
+    if ( st.st_size == 0 ) {
+      ::close( fd );
+      data_ = empty();
+      return true;
+    }
+    void* p = mmap( NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    // マップした後はファイル記述子は不要
+    ::close( fd );
+    if ( p == MAP_FAILED ) return false;
+    data_ = (const char*) p;
+    size_ = (size_t) st.st_size;
+#endif
+    return true;
+  };
+
+  void close() {
+#if defined(_WIN32)
+    if ( ( data_ != NULL ) && ( size_ != 0 ) ) UnmapViewOfFile( data_ );
+    if ( map_ != NULL ) CloseHandle( map_ );
+    if ( file_ != INVALID_HANDLE_VALUE ) CloseHandle( file_ );
+    map_ = NULL;
+    file_ = INVALID_HANDLE_VALUE;
+#else
+    if ( ( data_ != NULL ) && ( size_ != 0 ) ) munmap( (void*) data_, size_ );
+#endif
+    data_ = NULL;
+    size_ = 0;
+  };
+
+  bool isOpen() const { return ( data_ != NULL ) ? true : false; };
+  const char* data() const { return data_; };
+  size_t size() const { return size_; };
+
+private:
+
+  // 長さ 0 のファイルを開いたときの data()
+  static const char* empty() { return ""; };
+
+  // コピー禁止
+  MMapFile( const MMapFile& );
+  MMapFile& operator=( const MMapFile& );
+
+  const char* data_;
+  size_t size_;
+#if defined(_WIN32)
+  HANDLE file_;
+  HANDLE map_;
+#endif
+};
+
+#endif // _MMAPFILE_HXX
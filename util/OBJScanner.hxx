@@ -0,0 +1,138 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: OBJScanner.hxx 2026/10/18 21:12:06 kanai Exp $
+//
+// OBJ (SMF) file scanner on a memory mapped file
+//
+// Copyright (c) 2026 Takashi Kanai
+// Released under the MIT license
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef _OBJSCANNER_HXX
+#define _OBJSCANNER_HXX 1
+
+#include <cstring>
+#include <charconv>
+#include <string_view>
+
+#include "mydef.h"
+#include "MMapFile.hxx"
+
+//
+// OBJ (SMF) の 1 行の字句
+// - 空白 (スペース・タブ・CR) で区切った語を前から順に取り出す
+// - 数値は std::from_chars で変換する (ロケールに依存せず，文字列のコピーもしない)
+//
+class OBJLine {
+
+public:
+
+  OBJLine( const char* begin, const char* end ) : p_( begin ), e_( end ) {};
+
+  // 次の語 (なければ空)
+  std::string_view word() {
+    skipSpace();
+    const char* b = p_;
+    while ( ( p_ < e_ ) && !isSpace( *p_ ) ) ++p_;
+    return std::string_view( b, (size_t) ( p_ - b ) );
+  };
+
+  // 残りの語の数
+  int wordCount() const {
+    OBJLine l( *this );
+    int n = 0;
+    while ( !l.word().empty() ) ++n;
+    return n;
+  };
+
+  //
+  // 次の語を数値 (int, float, double) として読む
+  // 語がないか数値でなければ false を返す (x はそのまま．数値でない語は読み飛ばす)
+  //
+  template <class T>
+  bool number( T& x ) {
+    skipSpace();
+    if ( p_ == e_ ) return false;
+    if ( *p_ == '+' ) ++p_; // from_chars は '+' を受け付けない
+    std::from_chars_result r = std::from_chars( p_, e_, x );
+    if ( r.ec != std::errc() ) {
+      while ( ( p_ < e_ ) && !isSpace( *p_ ) ) ++p_;
+      return false;
+    }
+    p_ = r.ptr;
+    return true;
+  };
+
+  //
+  // 面の角 ("v", "v/t", "v//n", "v/t/n" など) の番号
+  // - 空でない番号を前から順に ids[0 ... 2] に入れ，その数を返す (角がなければ 0)
+  //   (tokenizer( str, "/" ) と同じく空の欄は詰める)
+  //
+  int corner( int ids[3] ) {
+    skipSpace();
+    int n = 0;
+    while ( ( p_ < e_ ) && !isSpace( *p_ ) ) {
+      if ( *p_ == '/' ) { ++p_; continue; }
+      int id = 0;
+      std::from_chars_result r = std::from_chars( p_, e_, id );
+      if ( r.ec != std::errc() ) {
+        while ( ( p_ < e_ ) && !isSpace( *p_ ) && ( *p_ != '/' ) ) ++p_;
+        continue;
+      }
+      p_ = r.ptr;
+      if ( n < 3 ) ids[n++] = id;
+    }
+    return n;
+  };
+
+private:
+
+  static bool isSpace( char c ) { return ( c == ' ' ) || ( c == '\t' ) || ( c == '\r' ); };
+  void skipSpace() { while ( ( p_ < e_ ) && isSpace( *p_ ) ) ++p_; };
+
+  const char* p_;
+  const char* e_;
+};
+
+//
+// OBJ (SMF) ファイルの走査
+// - ファイルを MMapFile でマップし，バイト列を memchr で改行ごとに区切って直接読む
+//   (getline・行ごとの istringstream を使わないので，読み込みはほぼディスクの速さで決まる)
+// - 要素の数は行頭の語だけを見る走査で先に数え，配列を確保してから 1 回で読み込む
+// - 空行とコメント行 (mycomment) は飛ばす
+//
+class OBJScanner {
+
+public:
+
+  OBJScanner() {};
+  ~OBJScanner() {};
+
+  bool open( const char* filename ) { return file_.open( filename ); };
+  void close() { file_.close(); };
+  bool isOpen() const { return file_.isOpen(); };
+  size_t size() const { return file_.size(); };
+
+  // 行ごとに f( OBJLine& ) を呼ぶ
+  template <class Func>
+  void forEachLine( Func&& f ) const {
+    const char* p = file_.data();
+    const char* e = p + file_.size();
+    while ( p < e ) {
+      const char* q = (const char*) memchr( p, '\n', (size_t) ( e - p ) );
+      if ( q == NULL ) q = e;
+      if ( ( p < q ) && !mycomment( *p ) ) {
+        OBJLine line( p, q );
+        f( line );
+      }
+      p = q + 1;
+    }
+  };
+
+private:
+
+  MMapFile file_;
+};
+
+#endif // _OBJSCANNER_HXX
@@ -0,0 +1,218 @@
+////////////////////////////////////////////////////////////////////
+//
+// $Id: ThreadPool.hxx 2026/10/18 11:20:36 kanai Exp $
+//
+// work-stealing thread pool
+//
+// Copyright (c) 2026 Takashi Kanai
+// Released under the MIT license
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef _THREADPOOL_HXX
+#define _THREADPOOL_HXX 1
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <chrono>
+using namespace std;
+
+//
+// ワークスティーリング型のスレッドプール
+// - ワーカーごとにタスクの deque を持ち，自分の deque は後ろから，
+//   他のワーカーの deque は前から (steal) 取り出す
+// - size() 個のスレッドで処理する．呼び出し側のスレッドも
+//   TaskGroup::wait() の中でタスクを実行するので，ワーカーは size()-1 個
+//
+class ThreadPool {
+
+public:
+
+  // n: スレッド数 (0 のときはハードウェアのスレッド数)
+  ThreadPool( int n = 0 ) : stop_(false), n_tasks_(0), next_(0) {
+    if ( n <= 0 ) n = (int) std::thread::hardware_concurrency();
+    if ( n <= 0 ) n = 1;
+    size_ = n;
+    queues_.resize( n );
+    for ( int i = 0; i < n; ++i ) queues_[i] = new WorkQueue;
+    for ( int i = 1; i < n; ++i )
+      workers_.push_back( std::thread( &ThreadPool::workerLoop, this, i ) );
+  };
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock( sleep_mutex_ );
+      stop_ = true;
+    }
+    sleep_cv_.notify_all();
+    for ( auto& th : workers_ ) th.join();
+    for ( auto q : queues_ ) delete q;
+  };
+
+  int size() const { return size_; };
+
+  // 既定のスレッドプール (ハードウェアのスレッド数)
+  static ThreadPool& instance() {
+    static ThreadPool pool;
+    return pool;
+  };
+
+  // タスクの追加
+  // ワーカーから呼ばれた場合は自分の deque に，それ以外は順番に振り分ける
+  // n_tasks_ は sleep_mutex_ の中で増やす (眠りかけのワーカーが通知を取りこぼさないように)
+  void push( std::function<void()> task ) {
+    int id = ( current() == this ) ? workerID() : (int) ( next_++ % size_ );
+    {
+      std::lock_guard<std::mutex> lock( sleep_mutex_ );
+      ++n_tasks_;
+    }
+    {
+      std::lock_guard<std::mutex> lock( queues_[id]->mutex_ );
+      queues_[id]->tasks_.push_back( std::move( task ) );
+    }
+    sleep_cv_.notify_one();
+  };
+
+  // タスクをひとつ取り出して実行する．実行できるタスクがなければ false
+  bool runOne() {
+    std::function<void()> task;
+    if ( !pop( task ) ) return false;
+    task();
+    return true;
+  };
+
+private:
+
+  struct WorkQueue {
+    std::mutex mutex_;
+    std::deque<std::function<void()> > tasks_;
+  };
+
+  // 自分の deque の後ろから取り出し，なければ他から盗む
+  bool pop( std::function<void()>& task ) {
+    if ( n_tasks_.load() == 0 ) return false;
+
+    int id = ( current() == this ) ? workerID() : 0;
+    {
+      WorkQueue* q = queues_[id];
+      std::lock_guard<std::mutex> lock( q->mutex_ );
+      if ( !q->tasks_.empty() ) {
+        task = std::move( q->tasks_.back() );
+        q->tasks_.pop_back();
+        --n_tasks_;
+        return true;
+      }
+    }
+
+    for ( int i = 1; i < size_; ++i ) {
+      WorkQueue* q = queues_[ (id + i) % size_ ];
+      std::lock_guard<std::mutex> lock( q->mutex_ );
+      if ( !q->tasks_.empty() ) {
+        task = std::move( q->tasks_.front() );
+        q->tasks_.pop_front();
+        --n_tasks_;
+        return true;
+      }
+    }
+    return false;
+  };
+
+  void workerLoop( int id ) {
+    current() = this;
+    workerID() = id;
+    while ( true ) {
+      if ( runOne() ) continue;
+
+      std::unique_lock<std::mutex> lock( sleep_mutex_ );
+      if ( stop_ ) return;
+      sleep_cv_.wait( lock, [this]{ return stop_ || ( n_tasks_.load() > 0 ); } );
+      if ( stop_ ) return;
+    }
+  };
+
+  // 実行中のスレッドが属するプールとワーカー番号
+  static ThreadPool*& current() {
+    static thread_local ThreadPool* pool = NULL;
+    return pool;
+  };
+  static int& workerID() {
+    static thread_local int id = 0;
+    return id;
+  };
+
+  int size_;
+  std::vector<WorkQueue*> queues_;
+  std::vector<std::thread> workers_;
+
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+  bool stop_;
+
+  std::atomic<int> n_tasks_;
+  std::atomic<unsigned int> next_;
+};
+
+//
+// タスクのグループ
+// - run() でタスクを追加し，wait() で全タスクの終了を待つ
+// - wait() の間は呼び出し側のスレッドもタスクを実行するので，
+//   タスクの中で入れ子に TaskGroup を使ってもよい
+//
+class TaskGroup {
+
+public:
+
+  TaskGroup( ThreadPool& pool = ThreadPool::instance() ) : pool_(pool), pending_(0) {};
+  ~TaskGroup() { wait(); };
+
+  void run( std::function<void()> task ) {
+    ++pending_;
+    pool_.push( [this, task]() { task(); --pending_; } );
+  };
+
+  void wait() {
+    while ( pending_.load() > 0 ) {
+      if ( !pool_.runOne() ) std::this_thread::yield();
+    }
+  };
+
+  ThreadPool& pool() { return pool_; };
+
+private:
+
+  ThreadPool& pool_;
+  std::atomic<int> pending_;
+};
+
+//
+// [begin, end) を grain 個以下の区間に再帰的に分割して並列に f(b, e) を実行する
+//
+template <class Func>
+inline void parallelForRange( ThreadPool& pool, int begin, int end, int grain, const Func& f ) {
+  if ( end - begin <= 0 ) return;
+  if ( grain < 1 ) grain = 1;
+  if ( ( pool.size() == 1 ) || ( end - begin <= grain ) ) {
+    f( begin, end );
+    return;
+  }
+
+  TaskGroup tg( pool );
+  int mid = begin + (end - begin) / 2;
+  tg.run( [&pool, mid, end, grain, &f]() { parallelForRange( pool, mid, end, grain, f ); } );
+  parallelForRange( pool, begin, mid, grain, f );
+  tg.wait();
+};
+
+// 各 i に対して f(i) を並列に実行する
+template <class Func>
+inline void parallelFor( ThreadPool& pool, int begin, int end, int grain, const Func& f ) {
+  parallelForRange( pool, begin, end, grain,
+                    [&f]( int b, int e ) { for ( int i = b; i < e; ++i ) f( i ); } );
+};
+
+#endif // _THREADPOOL_HXX
@@ -265,6 +265,7 @@ inline void bcp( std::vector<Eigen::Vector3d>&, std::vector<double>&, Eigen::Vec
 
 //
 // point to face distance
+// (縮退した三角形では -1 を返す．確保なしで何度も呼ぶ場合は triClosestPoint() を使う)
 //
 inline double triPointDistance( Eigen::Vector3d& p, std::vector<Eigen::Vector3d>& triverts,
                                 std::vector<double>& bCoords )
@@ -466,6 +467,96 @@ inline double triPointDistance( Eigen::Vector3d& p, std::vector<Eigen::Vector3d>
   return dis;
 }
 
+//
+// 三角形 abc 上で点 p に最も近い点 q を求め，その距離を返す
+// bc には q の重心座標 (q = bc[0] * a + bc[1] * b + bc[2] * c) を入れる
+//  from Ericson, C., "Real-Time Collision Detection", 5.1.5.
+//
+// triPointDistance() との違い: 三角形と重心座標を std::vector で受け取らないので
+// 呼び出しごとの確保がなく，BVH・octree の最近点探索のように何度も呼ぶ場合に使う．
+// また縮退した三角形でも -1 を返さず辺・頂点までの距離を返し，
+// 頂点の領域でも重心座標と q を設定する．
+// (triPointDistance() は既存の呼び出し側のためにそのまま残す)
+//
+inline double triClosestPoint( const Eigen::Vector3d& p, const Eigen::Vector3d& a,
+                               const Eigen::Vector3d& b, const Eigen::Vector3d& c,
+                               Eigen::Vector3d& q, double bc[3] )
+{
+  Eigen::Vector3d ab( b - a );
+  Eigen::Vector3d ac( c - a );
+  Eigen::Vector3d ap( p - a );
+
+  // 頂点 a の領域
+  double d1 = ab.dot( ap );
+  double d2 = ac.dot( ap );
+  if ( (d1 <= 0.0) && (d2 <= 0.0) )
+    {
+      bc[0] = 1.0; bc[1] = 0.0; bc[2] = 0.0;
+      q = a;
+      return (p - q).norm();
+    }
+
+  // 頂点 b の領域
+  Eigen::Vector3d bp( p - b );
+  double d3 = ab.dot( bp );
+  double d4 = ac.dot( bp );
+  if ( (d3 >= 0.0) && (d4 <= d3) )
+    {
+      bc[0] = 0.0; bc[1] = 1.0; bc[2] = 0.0;
+      q = b;
+      return (p - q).norm();
+    }
+
+  // 辺 ab の領域
+  double vc = d1 * d4 - d3 * d2;
+  if ( (vc <= 0.0) && (d1 >= 0.0) && (d3 <= 0.0) )
+    {
+      double v = d1 / (d1 - d3);
+      bc[0] = 1.0 - v; bc[1] = v; bc[2] = 0.0;
+      q = a + v * ab;
+      return (p - q).norm();
+    }
+
+  // 頂点 c の領域
+  Eigen::Vector3d cp( p - c );
+  double d5 = ab.dot( cp );
+  double d6 = ac.dot( cp );
+  if ( (d6 >= 0.0) && (d5 <= d6) )
+    {
+      bc[0] = 0.0; bc[1] = 0.0; bc[2] = 1.0;
+      q = c;
+      return (p - q).norm();
+    }
+
+  // 辺 ac の領域
+  double vb = d5 * d2 - d1 * d6;
+  if ( (vb <= 0.0) && (d2 >= 0.0) && (d6 <= 0.0) )
+    {
+      double w = d2 / (d2 - d6);
+      bc[0] = 1.0 - w; bc[1] = 0.0; bc[2] = w;
+      q = a + w * ac;
+      return (p - q).norm();
+    }
+
+  // 辺 bc の領域
+  double va = d3 * d6 - d5 * d4;
+  if ( (va <= 0.0) && ((d4 - d3) >= 0.0) && ((d5 - d6) >= 0.0) )
+    {
+      double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+      bc[0] = 0.0; bc[1] = 1.0 - w; bc[2] = w;
+      q = b + w * (c - b);
+      return (p - q).norm();
+    }
+
+  // 面の内部
+  double den = 1.0 / (va + vb + vc);
+  double v = vb * den;
+  double w = vc * den;
+  bc[0] = 1.0 - v - w; bc[1] = v; bc[2] = w;
+  q = a + v * ab + w * ac;
+  return (p - q).norm();
+}
+
 inline void V3Interpolate( Eigen::Vector3d& v1, Eigen::Vector3d& v2,
                            Eigen::Vector3d& v, double alpha )
 {
@@ -16,6 +16,7 @@
 
 #include <vector>
 #include <cassert>
+#include <limits>
 #include <ostream>
 using namespace std;
 
@@ -122,6 +123,13 @@ class PriorityQueue {
     last_ = 0;
   };
 
+  // empty the queue but keep the allocated memory (for reuse)
+  // the queued ids are marked as removed so that exist() returns false for them
+  void reset() {
+    for (int i = 0; i < last_; ++i) map_[list_[i].id()] = std::numeric_limits<int>::max();
+    last_ = 0;
+  };
+
   bool order() const { return order_; };
   void setOrder( bool order ) { order_ = order; };
 
@@ -145,13 +153,13 @@ class PriorityQueue {
       }
 #endif
 
+    if (node.id() >= (int) map_.size()) map_.resize(node.id() + 1);
     if (last_ < size()) {
       list_[last_].set(node);
-      map_[node.id()] = last_;
     } else {
       list_.push_back(node);
-      map_.push_back(last_);
     }
+    map_[node.id()] = last_;
 
     last_++;
 